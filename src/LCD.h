@@ -5,68 +5,123 @@
  *  Author: Arthur DUPONT
  */ 
 
-#include <avr/io.h>
+#include "hal.h"
 #include <stdlib.h>
 #include <stdint.h>
-#include <util/delay.h>
+#include <string.h>
 
-#ifdef LCD_USE_SOFTWARESERIAL
+// LCD link, chosen at build time:
+// - LCD_USE_SOFTWARESERIAL: bit-banged on PB1, timed by TIM2
+// - LCD_USE_USART: hardware USART, shared with the host through a TXD select pin (see usart.h)
+#if defined(LCD_USE_SOFTWARESERIAL)
 #include "softwareserial.h"
+#elif defined(LCD_USE_USART)
+#include "usart.h"
+#else
+#error "Select the LCD link: define LCD_USE_SOFTWARESERIAL or LCD_USE_USART"
 #endif
 
 #ifndef LCD_H_
 #define LCD_H_
 
+// LCD size in characters
+#define LCD_COLS 16
+#define LCD_ROWS 4
 
+// Shadow framebuffer, written by the menus and sent by lcdFlush()
+char lcd_fb[LCD_ROWS][LCD_COLS];
+// Content currently displayed on the LCD
+char lcd_glass[LCD_ROWS][LCD_COLS];
+// Current LCD cursor position, 0xFF if unknown
+uint8_t lcd_cursor_x = 0xFF, lcd_cursor_y = 0xFF;
 
-/**
- * Init the USART Peripheral to for the lcd
- * @param baud_rate The baud rate of the USART peripheral. Must be 19200 for the LCD
-*/
-void lcdUSARTInit(float baud_rate) {
-    UBRRH = 0x00; UBRRL = (float) F_CPU / (16. * baud_rate) - 1; // Set USART bitrate
-    UCSRB = 1<<TXEN | 1<<RXEN; // Enable USART TX/RX
-    UCSRC = 1<<URSEL | 1<<UCSZ1 | 1<<UCSZ0; // Set frame settings: Async, 8 Data bits, no parity, 1 Stop Bit
-}
+// Custom glyphs, 5x8 pixels, stored in the 8 CGRAM slots of the LCD controller
+// A glyph is displayed with the code LCD_GLYPH(slot): the controller mirrors
+// the slots 0-7 on the codes 8-15, and the code 0 would end the ASCII mode.
+#define LCD_GLYPHS 8
+#define LCD_GLYPH(slot) (8 + (slot))
+// Glyph wanted in each slot, and glyph loaded in the LCD (8 rows in flash, NULL if none)
+const uint8_t* lcd_glyphs[LCD_GLYPHS];
+const uint8_t* lcd_glyphs_loaded[LCD_GLYPHS];
 
 /**
- * Sends one byte synchronously through serial
+ * Sends one byte through serial
  * init() MUST be called once before using
+ * @note The byte is only queued, the function returns immediately unless the queue is full
 */
 void lcdPutChar(char byte) {
 	#ifdef LCD_USE_SOFTWARESERIAL
 	softwareSerialSend(byte);
 	#else
-	// TODO: Implement USART Again
+	usartLcdPutChar(byte);
+	#endif
+}
+
+/**
+ * Gives the LCD time to process the last command
+ * @param ms The time to wait in ms
+ * @note The wait is queued after the last bytes, the CPU is not blocked
+ * @note With the USART the line goes to the host during the wait
+*/
+void lcdWait(uint8_t ms) {
+	#ifdef LCD_USE_SOFTWARESERIAL
+	softwareSerialIdle((uint32_t)ms * SOFTWARESERIAL_BAUD / 1000);
+	#else
+	usartLcdIdle(ms);
 	#endif
 }
 
 /**
  * Clears the lcd screen and waits for 10ms
  * init() MUST be called once before using 
- * @note Waits 10ms for the LCD to clear
+ * @note Waits 10ms for the LCD to clear (see lcdWait)
 */
 void lcdClear() {
 	lcdPutChar(0xA3); // Go into CMD mode
 	lcdPutChar(0x01); // Clear the LCD and set cursor to 0,0
-	_delay_ms(10); // Wait for the LCD to clear
+	lcdWait(10); // Wait for the LCD to clear
+
+	memset(lcd_glass, ' ', sizeof(lcd_glass));
+	lcd_cursor_x = 0; lcd_cursor_y = 0;
+}
+
+/**
+ * Writes the rows of a glyph in the LCD controller CGRAM
+ * init() MUST be called once before using
+ * @param slot The glyph slot (0-7)
+ * @param rows The 8 rows in flash, 5 pixels each (bit 4 is the left pixel)
+ * @note Moves the LCD cursor out of the display, lcdGoto() must be called before printing
+*/
+void lcdLoadGlyph(uint8_t slot, const uint8_t* rows) {
+	lcdPutChar(0xA3); // Send the CMD byte
+	lcdPutChar(0x40 | (slot & 0x07) << 3); // Set the CGRAM address
+	lcdPutChar(0xA2); // Go into ASCII mode, the data goes to the CGRAM
+	// Bits 5-7 are not displayed, setting bit 5 keeps the blank rows from ending the ASCII mode
+	for (uint8_t i = 0; i < 8; i++)
+		lcdPutChar(pgm_read_byte(&rows[i]) | 0x20);
+	lcdPutChar(0x00); // Quit the ASCII mode
+
+	lcd_cursor_x = 0xFF; lcd_cursor_y = 0xFF;
 }
 
 /**
  * Initialize the LCD
  * MUST be called before using any of the functions
- * @note Waits 60ms for the LCD to start
+ * @note Waits 60ms for the LCD to start (see lcdWait)
+ * @note Global interrupts must be enabled
+ * @note With LCD_USE_USART, usartInit() MUST be called first
 */
 void lcdInit() {
-	uint8_t pin_tx = PB1;
 	#ifdef LCD_USE_SOFTWARESERIAL
+	uint8_t pin_tx = PB1;
 	softwareSerialInit(&DDRB, &pin_tx, NULL);
-	#else
-	lcdUSARTInit(19200);
 	#endif
 	lcdPutChar(0xA0); // Initialize LCD
-	_delay_ms(50); // Wait for the LCD to start
+	lcdWait(50); // Wait for the LCD to start
 	lcdClear(); // Clear the LCD (waits 10ms)
+
+	memset(lcd_fb, ' ', sizeof(lcd_fb));
+	memset(lcd_glyphs_loaded, 0, sizeof(lcd_glyphs_loaded));
 }
 
 /**
@@ -74,13 +129,15 @@ void lcdInit() {
  * init() MUST be called once before using
  * @param x The target X pos
  * @param y The target Y pos
- * @note Waits 10ms for the LCD to move
+ * @note Waits 10ms for the LCD to move (see lcdWait)
 */
 void lcdGoto(uint8_t x, uint8_t y) {
 	lcdPutChar(0xA1); // Send the MOVE byte
 	lcdPutChar(x);
 	lcdPutChar(y);
-	_delay_ms(10); // Wait for the LCD to move
+	lcdWait(10); // Wait for the LCD to move
+
+	lcd_cursor_x = x; lcd_cursor_y = y;
 }
 
 /**
@@ -92,11 +149,27 @@ void lcdGoto(uint8_t x, uint8_t y) {
 void lcdPrint(char* string) {
 	lcdPutChar(0xA2); // Go into ASCII mode
 	// Send each character
-    for (size_t i=0; string[i] != 0; i++)
+    for (size_t i=0; string[i] != 0; i++) {
         lcdPutChar(string[i]);
+        lcd_cursor_x++;
+    }
     lcdPutChar(0x00); // Quit the ASCII mode
 }
 
+/**
+ * Sends a string stored in flash through serial
+ * init() MUST be called once before using
+ * @param string The CString to print, in program memory (see PSTR())
+*/
+void lcdPrint_P(const char* string) {
+	lcdPutChar(0xA2); // Go into ASCII mode
+	for (char c = pgm_read_byte(string); c != 0; c = pgm_read_byte(++string)) {
+		lcdPutChar(c);
+		lcd_cursor_x++;
+	}
+	lcdPutChar(0x00); // Quit the ASCII mode
+}
+
 /**
  * Set the visibility of the LCD cursor
  * init() MUST be called once before using
@@ -111,4 +184,128 @@ void lcdSetCursor(uint8_t b) {
 }
 
 
+// Max number of bytes queued to send one line: goto, wait, ASCII mode, line, end
+#define LCD_LINE_COST (3 + 1 + 1 + LCD_COLS + 1)
+
+/**
+ * Checks if the LCD link can take a full line without waiting
+ * @returns Boolean, if sending a line now would have to wait
+*/
+uint8_t lcdBusy() {
+	#ifdef LCD_USE_SOFTWARESERIAL
+	return softwareSerialFree() < LCD_LINE_COST;
+	#else
+	return usartLcdFree() < LCD_LINE_COST;
+	#endif
+}
+
+/**
+ * Fills the framebuffer with spaces
+ * @note Nothing is sent until lcdFlush() is called
+*/
+void lcdFbClear() {
+	memset(lcd_fb, ' ', sizeof(lcd_fb));
+}
+
+/**
+ * Writes one character in the framebuffer
+ * @param x The X pos
+ * @param y The Y pos
+ * @param c The character, MUST not be 0
+ * @note Nothing is sent until lcdFlush() is called
+*/
+void lcdFbPutChar(uint8_t x, uint8_t y, char c) {
+	if (x < LCD_COLS && y < LCD_ROWS)
+		lcd_fb[y][x] = c;
+}
+
+/**
+ * Writes a string in the framebuffer, clipped at the end of the line
+ * @param x The X pos of the first character
+ * @param y The Y pos
+ * @param string The CString to write
+ * @note Nothing is sent until lcdFlush() is called
+*/
+void lcdFbPrint(uint8_t x, uint8_t y, const char* string) {
+	if (y >= LCD_ROWS)
+		return;
+	for (; x < LCD_COLS && *string != 0; x++, string++)
+		lcd_fb[y][x] = *string;
+}
+
+/**
+ * Writes a string stored in flash in the framebuffer, clipped at the end of the line
+ * @param x The X pos of the first character
+ * @param y The Y pos
+ * @param string The CString to write, in program memory (see PSTR())
+ * @note Nothing is sent until lcdFlush() is called
+*/
+void lcdFbPrint_P(uint8_t x, uint8_t y, const char* string) {
+	if (y >= LCD_ROWS)
+		return;
+	for (char c = pgm_read_byte(string); x < LCD_COLS && c != 0; x++, c = pgm_read_byte(++string))
+		lcd_fb[y][x] = c;
+}
+
+/**
+ * Sets the glyph of a slot, display it with the code LCD_GLYPH(slot)
+ * @param slot The glyph slot (0-7)
+ * @param rows The 8 rows in flash, 5 pixels each (bit 4 is the left pixel)
+ * @note The glyph is only sent by lcdFlush() if the slot holds an other one
+*/
+void lcdFbGlyph(uint8_t slot, const uint8_t* rows) {
+	lcd_glyphs[slot & 0x07] = rows;
+}
+
+/**
+ * Sends the framebuffer cells that differ from the LCD content
+ * Each line sends one span, from its first to its last changed cell, as rewriting
+ * a few unchanged cells is much cheaper than an other 10ms lcdGoto().
+ * The goto is skipped when the cursor is already at the start of the span.
+ * Changed glyphs are sent first, the cells already showing them change with them.
+ * @returns Boolean, if some cells are still waiting to be sent
+ * @note Stops when the LCD link cannot take a line without waiting, call it periodically
+*/
+uint8_t lcdFlush() {
+	for (uint8_t slot = 0; slot < LCD_GLYPHS; slot++) {
+		if (lcd_glyphs[slot] == lcd_glyphs_loaded[slot])
+			continue;
+		if (lcdBusy())
+			return 1;
+		lcdLoadGlyph(slot, lcd_glyphs[slot]);
+		lcd_glyphs_loaded[slot] = lcd_glyphs[slot];
+	}
+
+	for (uint8_t y = 0; y < LCD_ROWS; y++) {
+		// Find the changed span of the line
+		uint8_t first = LCD_COLS, last = 0;
+		for (uint8_t x = 0; x < LCD_COLS; x++) {
+			if (lcd_fb[y][x] != lcd_glass[y][x]) {
+				if (first == LCD_COLS) first = x;
+				last = x;
+			}
+		}
+		if (first == LCD_COLS)
+			continue;
+
+		// Wait for the previous spans to be sent
+		if (lcdBusy())
+			return 1;
+
+		if (lcd_cursor_x != first || lcd_cursor_y != y)
+			lcdGoto(first, y);
+
+		lcdPutChar(0xA2); // Go into ASCII mode
+		for (uint8_t x = first; x <= last; x++) {
+			lcdPutChar(lcd_fb[y][x]);
+			lcd_glass[y][x] = lcd_fb[y][x];
+		}
+		lcdPutChar(0x00); // Quit the ASCII mode
+
+		lcd_cursor_x = last + 1;
+	}
+
+	return 0;
+}
+
 #endif /* LCD_H_ */
\ No newline at end of file
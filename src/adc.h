@@ -0,0 +1,191 @@
+/*
+ * adc.h
+ *
+ * Created: 17/10/2026 00:25:32
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include "macros.h"
+
+#ifndef ADC_H_
+#define ADC_H_
+
+// Channels converted by the scanner, in order. A channel can appear several
+// times to be sampled more often. PA2 is used as a digital output.
+// ADC3 is the audio envelope of the level meter (see level.h), sampled at 7.2kHz
+#ifndef ADC_CHANNEL_LIST
+#define ADC_CHANNEL_LIST {0, 3, 3, 3}
+#endif
+// Channel only converted on request, see adcQuietRequest(). This is the LM335,
+// converted in the ADC noise reduction sleep mode by power.h
+#ifndef ADC_QUIET_CHANNEL
+#define ADC_QUIET_CHANNEL 1
+#endif
+// Conversions discarded after switching the MUX to ADC_QUIET_CHANNEL, while
+// the input settles
+#ifndef ADC_QUIET_SETTLE_COUNT
+#define ADC_QUIET_SETTLE_COUNT 1
+#endif
+// Number of samples accumulated per result, as a power of 2 (max 6)
+#ifndef ADC_OVERSAMPLE_LOG2
+#define ADC_OVERSAMPLE_LOG2 4
+#endif
+
+const uint8_t adc_channels[] = ADC_CHANNEL_LIST;
+#define ADC_CHANNEL_COUNT (sizeof(adc_channels) / sizeof(adc_channels[0]))
+
+// Per channel slots, indexed by the ADC channel number
+uint16_t adc_sum[8];                  // Running sums, only used by the ISR
+uint8_t adc_count[8];                 // Samples in the running sums, only used by the ISR
+volatile uint16_t adc_result[8];      // Last completed sums of 2^ADC_OVERSAMPLE_LOG2 samples
+volatile uint8_t adc_index = 0;       // Position of the running conversion in adc_channels
+
+enum AdcQuietState {
+  ADC_QUIET_OFF,     // The scanner runs
+  ADC_QUIET_REQUEST, // The scanner will stop after the running conversion
+  ADC_QUIET_SETTLE,  // The quiet channel is converted and discarded while it settles
+  ADC_QUIET_READY,   // The ADC is stopped on the quiet channel
+  ADC_QUIET_RUNNING  // The quiet channel is being converted
+};
+volatile uint8_t adc_quiet = ADC_QUIET_OFF;
+uint8_t adc_quiet_settle; // Settling conversions left, only used by the ISR
+
+/**
+ * Called from the ADC interrupt with each sample, MUST be defined by the application
+ * @param ch The ADC channel number
+ * @param sample The 10 bit conversion result
+ * @note Keep it short, it runs at the conversion rate (9.6kHz) with the interrupts disabled
+*/
+void adcHook(uint8_t ch, uint16_t sample);
+
+/**
+ * Starts the ADC scanner
+ * Conversions then run back to back from the ADC interrupt
+ * @note Global interrupts must be enabled for the scanner to run
+ * @note There is a known issue on the PCB causing the Volume knob to change the temperature reading. This is not a software bug.
+*/
+void adcInit() {
+  adc_index = 0;
+  // Configure the MUX to the first channel and the Ref to the AREF pin
+  ADMUX = (ADMUX & ~MUX_MASK) | (adc_channels[0] & MUX_MASK);
+  // Enable the ADC with its interrupt, /64 prescaler (125kHz ADC clock at 8MHz), and start the first conversion
+  ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADIF) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADSC);
+}
+
+/**
+ * Accumulates the finished conversion in its channel slot and starts the next channel
+*/
+ISR(ADC_vect) {
+  uint16_t sample = ADC;
+  uint8_t ch;
+
+  if (adc_quiet == ADC_QUIET_SETTLE) {
+    // The input was still settling, drop the sample
+    if (--adc_quiet_settle)
+      ADCSRA |= (1 << ADSC);
+    else
+      adc_quiet = ADC_QUIET_READY;
+    return;
+  }
+
+  if (adc_quiet == ADC_QUIET_RUNNING) {
+    // Quiet conversion done, resume the scan where it stopped
+    ch = ADC_QUIET_CHANNEL;
+    adc_quiet = ADC_QUIET_OFF;
+    ADMUX = (ADMUX & ~MUX_MASK) | (adc_channels[adc_index] & MUX_MASK);
+    ADCSRA |= (1 << ADSC);
+  } else {
+    ch = adc_channels[adc_index];
+    uint8_t next = adc_index + 1;
+    if (next >= ADC_CHANNEL_COUNT) next = 0;
+    adc_index = next;
+
+    if (adc_quiet == ADC_QUIET_REQUEST) {
+      // Stop on the quiet channel once it settled, see adcQuietStart()
+      ADMUX = (ADMUX & ~MUX_MASK) | (ADC_QUIET_CHANNEL & MUX_MASK);
+      adc_quiet_settle = ADC_QUIET_SETTLE_COUNT;
+      if (adc_quiet_settle) {
+        adc_quiet = ADC_QUIET_SETTLE;
+        ADCSRA |= (1 << ADSC);
+      } else {
+        adc_quiet = ADC_QUIET_READY;
+      }
+    } else {
+      // Switch to the next channel and start its conversion right away
+      ADMUX = (ADMUX & ~MUX_MASK) | (adc_channels[next] & MUX_MASK);
+      ADCSRA |= (1 << ADSC);
+    }
+  }
+
+  adcHook(ch, sample);
+
+  // Oversampling
+  adc_sum[ch] += sample;
+  if (++adc_count[ch] >= (1 << ADC_OVERSAMPLE_LOG2)) {
+    adc_result[ch] = adc_sum[ch];
+    adc_sum[ch] = 0;
+    adc_count[ch] = 0;
+  }
+}
+
+/**
+ * Asks the scanner to stop after its running conversion, for a conversion of ADC_QUIET_CHANNEL
+ * Wait for adcQuietReady() before calling adcQuietStart()
+*/
+void adcQuietRequest() {
+  adc_quiet = ADC_QUIET_REQUEST;
+}
+
+/**
+ * Checks if the scanner stopped and the quiet channel settled after adcQuietRequest()
+ * @returns Boolean, if adcQuietStart() can be called
+*/
+uint8_t adcQuietReady() {
+  return adc_quiet == ADC_QUIET_READY;
+}
+
+/**
+ * Converts ADC_QUIET_CHANNEL, the scanner resumes once it is done
+ * @param start Boolean, if the conversion is started now. Otherwise, it starts
+ *   when entering the ADC noise reduction sleep mode
+*/
+void adcQuietStart(uint8_t start) {
+  adc_quiet = ADC_QUIET_RUNNING;
+  if (start)
+    ADCSRA |= (1 << ADSC);
+}
+
+/**
+ * Checks if a quiet conversion is still pending
+*/
+uint8_t adcQuietBusy() {
+  return adc_quiet != ADC_QUIET_OFF;
+}
+
+/**
+ * Get the latest oversampled sum of a channel
+ * @param ch The ADC channel number
+ * @return The sum of the last 2^ADC_OVERSAMPLE_LOG2 samples
+ * @note Never waits for a conversion
+*/
+uint16_t adcGetSum(uint8_t ch) {
+  uint16_t sum;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    sum = adc_result[ch & 0x07];
+  }
+  return sum;
+}
+
+/**
+ * Get the latest filtered value of a channel
+ * @param ch The ADC channel number
+ * @return The 10 bit mean of the last 2^ADC_OVERSAMPLE_LOG2 samples
+ * @note Never waits for a conversion
+*/
+uint16_t adcGet(uint8_t ch) {
+  return adcGetSum(ch) >> ADC_OVERSAMPLE_LOG2;
+}
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * bench.h
+ *
+ * Created: 17/10/2026 00:31:44
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include "gpio.h"
+#include "menu.h"
+#include "usart.h"
+#include "format.h"
+#include "scheduler.h"
+#include "ringbuffer.h"
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+// Cycle benchmark of the firmware, built with BENCH defined (see [env:simavr])
+// Each case runs BENCH_RUNS times, timed with the TIM1 time base (8 cycles per
+// count), and the mean cost is printed on the USART:
+//   bench <name> <cycles>
+// The inputs (volume knob, temperature, tach, buttons) are injected at the
+// driver level so the runs do not depend on the simulated pins.
+
+#ifndef BENCH_RUNS
+#define BENCH_RUNS 32
+#endif
+#define BENCH_CYCLES_PER_COUNT (F_CPU / TICK_TIMER_HZ)
+// Entries moved through the ring per run
+#define BENCH_RING_BLOCK 32
+
+RING(bench_ring, uint8_t, 64);
+
+/**
+ * Prints one benchmark result
+ * @param name The case name, in flash (see PSTR())
+ * @param counts The total TIM1 counts of the BENCH_RUNS runs
+*/
+void benchReport(const char* name, uint32_t counts) {
+  char number[12] = " ";
+  fmtU32(number + 1, counts * BENCH_CYCLES_PER_COUNT / BENCH_RUNS, 0, ' ');
+
+  usartPrint_P(PSTR("bench "));
+  usartPrint_P(name);
+  usartPrint(number);
+  usartPutChar('\n');
+}
+
+/**
+ * Sets the injected inputs
+ * @param volume The volume knob ADC value
+ * @param temp The LM335 ADC value
+ * @param rpm_period The tach period in samples, 0 for a stopped fan
+*/
+void benchInputs(uint16_t volume, uint16_t temp, uint16_t rpm_period) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    adc_result[0] = volume << ADC_OVERSAMPLE_LOG2;
+    adc_result[1] = temp << ADC_OVERSAMPLE_LOG2;
+    tach_sum = rpm_period;
+    tach_count = rpm_period != 0;
+    tach_new = 1;
+  }
+}
+
+/**
+ * Runs every task of the table once, as a superloop iteration where all of them are due
+*/
+void benchSuperloop(Task* tasks, uint8_t count) {
+  uint16_t now = tickNow();
+  for (uint8_t i = 0; i < count; i++)
+    tasks[i].next = now;
+  schedRun(tasks, count);
+}
+
+/**
+ * Runs all the benchmark cases and stops the CPU
+ * @param tasks The application task table
+ * @param count The number of tasks
+ * @param mute_ The mute state, toggled by the button latency case
+ * @param fan_rpm_min_ The minimum fan speed setting
+ * @note simavr quits when the CPU sleeps with the interrupts disabled
+*/
+void benchRun(Task* tasks, uint8_t count, uint8_t* mute_, uint16_t* fan_rpm_min_) {
+  uint16_t fan_rpm = 0;
+  uint32_t total;
+
+  usartPrint_P(PSTR("bench start\n"));
+
+  // Menus ====================================
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    menuSet(i & 1 ? Fan : Stereo);
+    uint16_t start = timeNow();
+    menuUpdateStatic();
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("menuUpdateStatic"), total);
+
+  menuSet(Stereo);
+  menuUpdateStatic();
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    volume_level = i;
+    uint16_t start = timeNow();
+    menuUpdateDynamic();
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("menuUpdateDynamic"), total);
+
+  // Control loops ============================
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    benchInputs(512, 600 + i, 40 + (i & 7));
+    uint16_t start = timeNow();
+    handleFan(&fan_rpm, *fan_rpm_min_);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("handleFan"), total);
+
+  // The knob swings end to end, the pots ramp on every run
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    benchInputs(i & 1 ? 1023 : 0, 600, 40);
+    uint16_t start = timeNow();
+    handleVolume(*mute_);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("handleVolume"), total);
+
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    uint16_t start = timeNow();
+    setVolume(PD2, PD3, i * 3, 0);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("setVolume"), total);
+
+  // One BP+ press per run on the Stereo screen, applied to a copy of the state
+  uint8_t source_copy = 0, effects_copy = 0, mute_copy = 0;
+  uint16_t fan_rpm_min_copy = *fan_rpm_min_;
+  menuSet(Stereo);
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      buttonsPush(BUTTON_EVENT(BUTTON_PRESS, BUTTON_PLUS));
+    }
+    uint16_t start = timeNow();
+    handleButtons(&source_copy, &effects_copy, &mute_copy, &fan_rpm_min_copy);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("handleButtons"), total);
+
+  // Ring buffer throughput ===================
+  uint8_t block[BENCH_RING_BLOCK];
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    uint16_t start = timeNow();
+    for (uint8_t j = 0; j < BENCH_RING_BLOCK; j++)
+      RING_PUT(bench_ring, j);
+    for (uint8_t j = 0; j < BENCH_RING_BLOCK; j++)
+      RING_GET(bench_ring, block[j]);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("ring_put_get_32"), total);
+
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    uint16_t start = timeNow();
+    RING_WRITE(bench_ring, block, BENCH_RING_BLOCK);
+    RING_READ(bench_ring, block, BENCH_RING_BLOCK);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("ring_write_read_32"), total);
+
+  // Superloop ================================
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    benchInputs(i * 32, 600, 40);
+    uint16_t start = timeNow();
+    benchSuperloop(tasks, count);
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("superloop"), total);
+
+  // Button press to pot update latency =======
+  total = 0;
+  for (uint8_t i = 0; i < BENCH_RUNS; i++) {
+    uint8_t mute = *mute_;
+    uint16_t start = timeNow();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      buttonsPush(BUTTON_EVENT(BUTTON_PRESS, BUTTON_MUTE));
+    }
+    while (pot_stereo.mute == mute || *mute_ == mute) {
+      schedRun(tasks, count);
+      halIdle();
+    }
+    total += (uint16_t)(timeNow() - start);
+  }
+  benchReport(PSTR("button_to_pot"), total);
+
+  usartPrint_P(PSTR("bench end\n"));
+  usartFlush(); // The report is lost if the CPU halts first
+
+  cli();
+  sleep_enable();
+  sleep_cpu();
+  #ifdef NATIVE
+  exit(0);
+  #endif
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * buttons.h
+ *
+ * Created: 17/10/2026 00:29:07
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include "tick.h"
+#include "ringbuffer.h"
+
+#ifndef BUTTONS_H_
+#define BUTTONS_H_
+
+enum ButtonList {
+  BUTTON_MENU,  // PB2
+  BUTTON_MINUS, // PB5
+  BUTTON_PLUS,  // PB6
+  BUTTON_MUTE,  // PC1
+  BUTTON_OVERFLOW
+};
+enum ButtonEventType {
+  BUTTON_PRESS,   // The button was pushed
+  BUTTON_RELEASE, // The button was released
+  BUTTON_LONG,    // The button is held for BUTTON_LONG_MS
+  BUTTON_REPEAT   // The button is still held, sent every BUTTON_REPEAT_MS after BUTTON_LONG
+};
+// Events pack the type in the high nibble and the button in the low nibble
+#define BUTTON_EVENT(type, button) ((type) << 4 | (button))
+#define BUTTON_EVENT_TYPE(event) ((event) >> 4)
+#define BUTTON_EVENT_BUTTON(event) ((event) & 0x0F)
+#define BUTTON_NONE 0xFF
+
+// Sampling period of the debouncer, in ticks. A state change is accepted after 4 equal samples
+#ifndef BUTTON_SAMPLE_TICKS
+#define BUTTON_SAMPLE_TICKS 5
+#endif
+#ifndef BUTTON_LONG_MS
+#define BUTTON_LONG_MS 600
+#endif
+#ifndef BUTTON_REPEAT_MS
+#define BUTTON_REPEAT_MS 150
+#endif
+// Buttons generating BUTTON_REPEAT events
+#ifndef BUTTON_REPEAT_MASK
+#define BUTTON_REPEAT_MASK ((1 << BUTTON_MINUS) | (1 << BUTTON_PLUS))
+#endif
+#define BUTTON_SAMPLE_MS (BUTTON_SAMPLE_TICKS * 1000UL / TICK_HZ)
+#define BUTTON_LONG_SAMPLES (BUTTON_LONG_MS / BUTTON_SAMPLE_MS)
+#define BUTTON_REPEAT_SAMPLES (BUTTON_REPEAT_MS / BUTTON_SAMPLE_MS)
+
+// Size of the event queue, MUST be a power of 2
+#ifndef BUTTON_QUEUE_SIZE
+#define BUTTON_QUEUE_SIZE 8
+#endif
+
+// Debouncer state, only used by the ISR. One bit per button
+uint8_t button_state = 0;                 // Debounced state, 1 = pushed
+uint8_t button_ct0 = 0xFF, button_ct1 = 0xFF; // 2 bit vertical counters
+uint8_t button_divider = 0;               // Tick counter for the sampling period
+uint8_t button_held[BUTTON_OVERFLOW];     // Samples since the press, saturated
+
+// Event queue, filled by the ISR and emptied by the main loop
+RING(button_queue, uint8_t, BUTTON_QUEUE_SIZE);
+
+/**
+ * Reads the raw state of all the buttons at once
+ * @return One bit per button (see ButtonList), 1 = pushed
+*/
+uint8_t buttonsRead() {
+  uint8_t pinb = PINB, pinc = PINC;
+  return ((pinb >> PB2) & 1) << BUTTON_MENU
+       | ((pinb >> PB5) & 1) << BUTTON_MINUS
+       | ((pinb >> PB6) & 1) << BUTTON_PLUS
+       | ((pinc >> PC1) & 1) << BUTTON_MUTE;
+}
+
+/**
+ * Adds an event to the queue
+ * @note The event is dropped if the queue is full
+*/
+void buttonsPush(uint8_t event) {
+  if (RING_FULL(button_queue))
+    return;
+  RING_PUT(button_queue, event);
+}
+
+/**
+ * Debounces the buttons and generates the events
+ * MUST be called on each tick, from the tick interrupt
+*/
+void buttonsSample() {
+  if (++button_divider < BUTTON_SAMPLE_TICKS)
+    return;
+  button_divider = 0;
+
+  // Vertical counters: each button whose raw state differs from its debounced
+  // state counts down, and toggles after 4 samples in a row
+  uint8_t changed = button_state ^ buttonsRead();
+  button_ct0 = ~(button_ct0 & changed);
+  button_ct1 = button_ct0 ^ (button_ct1 & changed);
+  changed &= button_ct0 & button_ct1;
+  button_state ^= changed;
+
+  for (uint8_t b = 0; b < BUTTON_OVERFLOW; b++) {
+    uint8_t mask = 1 << b;
+
+    if (changed & mask) {
+      button_held[b] = 0;
+      buttonsPush(BUTTON_EVENT(button_state & mask ? BUTTON_PRESS : BUTTON_RELEASE, b));
+      continue;
+    }
+    if (!(button_state & mask) || button_held[b] == UINT8_MAX)
+      continue;
+
+    // Held button
+    button_held[b]++;
+    if (button_held[b] == BUTTON_LONG_SAMPLES) {
+      buttonsPush(BUTTON_EVENT(BUTTON_LONG, b));
+    } else if (button_held[b] == BUTTON_LONG_SAMPLES + BUTTON_REPEAT_SAMPLES && (BUTTON_REPEAT_MASK & mask)) {
+      buttonsPush(BUTTON_EVENT(BUTTON_REPEAT, b));
+      button_held[b] = BUTTON_LONG_SAMPLES;
+    }
+  }
+}
+
+/**
+ * Get the oldest button event
+ * @return The event (see BUTTON_EVENT), BUTTON_NONE if the queue is empty
+*/
+uint8_t buttonsGetEvent() {
+  if (RING_EMPTY(button_queue))
+    return BUTTON_NONE;
+
+  uint8_t event;
+  RING_GET(button_queue, event);
+  return event;
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * eeprom.h
+ *
+ * Created: 17/10/2026 00:40:49
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+// Interrupt driven EEPROM writer
+// A byte takes ~8.5ms to program, so eepromWrite() only copies the block and
+// returns. The EE_RDY interrupt then programs one byte each time the EEPROM is
+// ready. Bytes that already hold the right value are skipped, saving both the
+// time and the wear.
+
+#define EEPROM_SIZE 1024
+// Max size of one written block
+#ifndef EEPROM_BUFFER_SIZE
+#define EEPROM_BUFFER_SIZE 16
+#endif
+
+// Block being written, only read by the ISR while EERIE is set
+uint8_t eeprom_buf[EEPROM_BUFFER_SIZE];
+uint16_t eeprom_address;
+uint8_t eeprom_length;
+volatile uint8_t eeprom_index;
+
+/**
+ * Checks if a block is still being written
+ * @returns Boolean, if eepromWrite() would have to wait
+*/
+uint8_t eepromBusy() {
+  return (EECR & (1 << EERIE)) != 0;
+}
+
+/**
+ * Reads one byte
+ * @param address The EEPROM address
+ * @note Waits for the byte being programmed, if any
+*/
+uint8_t eepromReadByte(uint16_t address) {
+  while (1) {
+    // The EE_RDY interrupt also uses EEAR
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      if (!(EECR & (1 << EEWE))) {
+        EEAR = address;
+        EECR |= (1 << EERE);
+        return EEDR;
+      }
+    }
+    halIdle();
+  }
+}
+
+/**
+ * Reads a block
+ * @param address The EEPROM address of the first byte
+ * @param data Filled with the block
+ * @param length The number of bytes
+ * @note Waits for the byte being programmed, if any
+*/
+void eepromRead(uint16_t address, void* data, uint8_t length) {
+  uint8_t* bytes = data;
+  for (uint8_t i = 0; i < length; i++)
+    bytes[i] = eepromReadByte(address + i);
+}
+
+/**
+ * Starts writing a block, the bytes are programmed from the EE_RDY interrupt
+ * @param address The EEPROM address of the first byte
+ * @param data The block, copied so it can be changed right away
+ * @param length The number of bytes, at most EEPROM_BUFFER_SIZE
+ * @note Waits for the previous block, check eepromBusy() to avoid it
+ * @note Global interrupts must be enabled
+*/
+void eepromWrite(uint16_t address, const void* data, uint8_t length) {
+  while (eepromBusy())
+    halIdle();
+
+  if (length > EEPROM_BUFFER_SIZE)
+    length = EEPROM_BUFFER_SIZE;
+  memcpy(eeprom_buf, data, length);
+  eeprom_address = address;
+  eeprom_length = length;
+  eeprom_index = 0;
+  EECR |= (1 << EERIE); // Fires as soon as the EEPROM is ready
+}
+
+/**
+ * EEPROM ready interrupt, programs the next byte that differs
+*/
+ISR(EE_RDY_vect) {
+  while (eeprom_index < eeprom_length) {
+    uint16_t address = eeprom_address + eeprom_index;
+    uint8_t byte_ = eeprom_buf[eeprom_index++];
+
+    EEAR = address;
+    EECR |= (1 << EERE);
+    if (EEDR == byte_)
+      continue;
+
+    // EEWE must be set within 4 cycles of EEMWE, the interrupts are already disabled
+    EEDR = byte_;
+    EECR |= (1 << EEMWE);
+    EECR |= (1 << EEWE);
+    return;
+  }
+
+  // Block done
+  EECR &= ~(1 << EERIE);
+}
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * fixed.h
+ *
+ * Created: 17/10/2026 00:25:08
+ * Author : agent
+ */
+
+#include <stdint.h>
+
+#ifndef FIXED_H_
+#define FIXED_H_
+
+// The ATmega32 has no FPU, every float operation is a call to the soft-float
+// library. These helpers do the same maths on integers.
+
+typedef int16_t q8_8_t;   // Signed fixed point, 8 integer bits, 8 fractional bits
+typedef int32_t q16_16_t; // Signed fixed point, 16 integer bits, 16 fractional bits
+
+/**
+ * Converts a constant to Q8.8 at compile time
+ * @note Only use with constant expressions, otherwise the float maths runs on the MCU
+*/
+#define Q8_8(x) ((q8_8_t)((x) * 256. + ((x) >= 0 ? 0.5 : -0.5)))
+/**
+ * Converts a constant to Q16.16 at compile time
+ * @note Only use with constant expressions, otherwise the float maths runs on the MCU
+*/
+#define Q16_16(x) ((q16_16_t)((x) * 65536. + ((x) >= 0 ? 0.5 : -0.5)))
+
+/**
+ * Saturates a 32 bit value into the int16_t range
+*/
+int16_t sat16(int32_t x) {
+  if (x > INT16_MAX) return INT16_MAX;
+  if (x < INT16_MIN) return INT16_MIN;
+  return x;
+}
+/**
+ * Saturates a value into the uint8_t range
+*/
+uint8_t satU8(int16_t x) {
+  if (x > UINT8_MAX) return UINT8_MAX;
+  if (x < 0) return 0;
+  return x;
+}
+/**
+ * Saturating 16 bit addition
+*/
+int16_t satAdd16(int16_t a, int16_t b) {
+  return sat16((int32_t)a + b);
+}
+/**
+ * Saturating 16 bit subtraction
+*/
+int16_t satSub16(int16_t a, int16_t b) {
+  return sat16((int32_t)a - b);
+}
+
+/**
+ * Converts an integer to Q8.8
+ * @note Saturates outside of [-128, 127]
+*/
+q8_8_t q88FromInt(int16_t x) {
+  return sat16((int32_t)x << 8);
+}
+/**
+ * Converts a Q8.8 to the nearest integer
+*/
+int16_t q88ToInt(q8_8_t x) {
+  return (x + 0x80) >> 8;
+}
+/**
+ * Saturating Q8.8 multiplication
+*/
+q8_8_t q88Mul(q8_8_t a, q8_8_t b) {
+  return sat16(((int32_t)a * b + 0x80) >> 8);
+}
+/**
+ * Saturating Q8.8 division, truncated towards 0
+ * @note Returns the saturated value of the sign of a when b is 0
+*/
+q8_8_t q88Div(q8_8_t a, q8_8_t b) {
+  if (b == 0) return a < 0 ? INT16_MIN : INT16_MAX;
+  return sat16(((int32_t)a << 8) / b);
+}
+
+/**
+ * Converts a Q16.16 to the nearest integer
+*/
+int32_t q1616ToInt(q16_16_t x) {
+  return (x + 0x8000) >> 16;
+}
+/**
+ * Multiplies an integer by a Q16.16 factor and rounds the result
+ * @note Cheaper than q1616Mul when one side is an integer
+*/
+int32_t q1616MulInt(q16_16_t a, int16_t x) {
+  return q1616ToInt(a * x);
+}
+/**
+ * Q16.16 multiplication
+ * @note Uses a 64 bit intermediate, prefer q1616MulInt when possible
+*/
+q16_16_t q1616Mul(q16_16_t a, q16_16_t b) {
+  return ((int64_t)a * b + 0x8000) >> 16;
+}
+
+/**
+ * Integer square root
+ * @returns The floor of the square root of x
+ * @note One bit per iteration, no multiplication
+*/
+uint8_t isqrt16(uint16_t x) {
+  uint16_t root = 0;
+  uint16_t bit = 1 << 14;
+  while (bit > x)
+    bit >>= 2;
+  while (bit) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/**
+ * Scales a 10 bit ADC reading to [0, full] with rounding
+ * @param x The ADC reading (0-1023)
+ * @param full The value returned at full scale
+ * @note Divides by 1024 (a shift) instead of 1023, the difference is below the rounding
+*/
+uint16_t fixedScaleU10(uint16_t x, uint16_t full) {
+  return ((uint32_t)x * full + 512) >> 10;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * format.h
+ *
+ * Created: 17/10/2026 00:37:10
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+
+#ifndef FORMAT_H_
+#define FORMAT_H_
+
+// Small number to text converters, replacing sprintf and the large printf
+// implementation it pulls in. The numbers are right aligned on a minimum
+// width, like "%*u", and the functions return the end of the text so the
+// calls can be chained.
+
+// Powers of ten of the uint16_t digits, the ATmega32 has no divider so the
+// digits are found by subtraction
+const uint16_t fmt_powers[5] PROGMEM = {10000, 1000, 100, 10, 1};
+
+/**
+ * Writes an unsigned 16 bit number in decimal
+ * @param buf The destination, at least max(width, 5)+1 chars
+ * @param value The number
+ * @param width The minimum number of characters, wider numbers are not cut
+ * @param pad The character filling the left of the field (' ' or '0')
+ * @returns A pointer to the terminating 0
+*/
+char* fmtU16(char* buf, uint16_t value, uint8_t width, char pad) {
+  char digits[5];
+  for (uint8_t i = 0; i < 5; i++) {
+    uint16_t power = pgm_read_word(&fmt_powers[i]);
+    char digit = '0';
+    while (value >= power) {
+      value -= power;
+      digit++;
+    }
+    digits[i] = digit;
+  }
+
+  // Skip the leading zeros, keeping at least one digit
+  uint8_t first = 0;
+  while (first < 4 && digits[first] == '0')
+    first++;
+
+  for (uint8_t length = 5 - first; length < width; length++)
+    *buf++ = pad;
+  for (; first < 5; first++)
+    *buf++ = digits[first];
+  *buf = '\0';
+  return buf;
+}
+
+/**
+ * Writes an unsigned 32 bit number in decimal
+ * @param buf The destination, at least max(width, 10)+1 chars
+ * @param value The number
+ * @param width The minimum number of characters, wider numbers are not cut
+ * @param pad The character filling the left of the field (' ' or '0')
+ * @returns A pointer to the terminating 0
+ * @note Uses 32 bit divisions, prefer fmtU16 in the periodic code
+*/
+char* fmtU32(char* buf, uint32_t value, uint8_t width, char pad) {
+  char digits[10];
+  uint8_t length = 0;
+  do {
+    digits[length++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  for (uint8_t i = length; i < width; i++)
+    *buf++ = pad;
+  while (length)
+    *buf++ = digits[--length];
+  *buf = '\0';
+  return buf;
+}
+
+#endif
@@ -5,9 +5,17 @@
  * Author : Arthur DUPONT
  */
 
-#include <avr/io.h>
+#include "hal.h"
 #include "menu.h"
 #include "macros.h"
+#include "fixed.h"
+#include "adc.h"
+#include "temp.h"
+#include "tick.h"
+#include "tach.h"
+#include "pid.h"
+#include "buttons.h"
+#include "profiler.h"
 
 #ifndef GPIO_H_
 #define GPIO_H_
@@ -63,34 +71,41 @@ void initGpio() {
 
 
   // Temperature/Volume Reading
-  // Enable the ADC
-  ADCSRA = (1 << ADEN);
+  // Start the ADC scanner
+  adcInit();
 
   // For the FAN PWM generation
   // Set TIM0 in Fast PWM mode, output on OC0, and with a /8 prescaler
   TCCR0 = (1 << WGM00) | (1 << WGM01) | (1 << COM01) | (1 << CS01);
+  // Sample the fan tach on each PWM period
+  tachInit();
 
-  // For the fan tach counter
-  // Set TIM1A in Normal mode, with a /1024 prescaler
-  TCCR1B = (1 << CS11) | (1 << CS12);
+  // For the fan tach counter and the system tick
+  // Start the TIM1 time base
+  tickInit();
 }
 
 
 /**
- * Configures the digital potentiometer with the given data.
+ * Get the digital potentiometer step for a volume
+ * @param volume The volume level (0-100%)
+ * @return The wiper step, the Pot has 64 steps (0 is the loudest)
+*/
+uint8_t volumeToStep(uint8_t volume) {
+  return q1616MulInt(Q16_16(63. / 100.), 100 - volume);
+}
+
+/**
+ * Writes raw wiper steps to the digital potentiometer.
  * @details Implements a software SPI-like interface.
  * @param clk The clock pin
  * @param rst The reset pin
- * @param volume The volume level to set
+ * @param s0 The step of the wiper 0
+ * @param s1 The step of the wiper 1
  * @param mute Mute signal
  * @note The digital potentiometer does not completely mute the sound, even when muted.
 */
-void setVolume(char clk, char rst, char volume, char mute) {
-  // Get the volume %
-  float vol = (float)volume / 100.;
-  char s0 = (1-vol) * 63.; // Get the step number for the current
-  char s1 = (1-vol) * 63.; // volume. the Pot has 64 steps.
-
+void potWrite(char clk, char rst, char s0, char s1, char mute) {
   // Pull RST HIGH at the start of the com
   PORTD |= 1 << rst;
 
@@ -143,170 +158,210 @@ void setVolume(char clk, char rst, char volume, char mute) {
   // Pull RST LOW at the end of the com
   PORTD &= ~(1 << rst);
 }
+
 /**
- * Start an ADC conversion and synchronously read the result.
- * ADC must be enabled beforehand.
- * @param pin The ADC pin number to read.
- * @return The 10 bit adc value.
- * @note There is a known issue on the PCB causing the Volume knob to change the temperature reading. This is not a software bug.
+ * Configures the digital potentiometer with the given data.
+ * @param clk The clock pin
+ * @param rst The reset pin
+ * @param volume The volume level to set
+ * @param mute Mute signal
+ * @note The digital potentiometer does not completely mute the sound, even when muted.
 */
-uint16_t readADC(uint8_t pin) {
-  // Check if the ADC is enabled
-  if ( !(ADCSRA & (1 << ADEN)) )
-    return 0;
-
-  // Clear the previous ADC interupt
-  ADCSRA = (1 << ADEN) | (1 << ADIF);
-  // Configure the MUX to the desired pin and the Ref to the AREF pin
-  ADMUX = (ADMUX & ~MUX_MASK) | (pin & MUX_MASK);
-
-  // Start the conversion
-  ADCSRA |= (1 << ADSC);
-  // Wait for the conversion
-  while ( ~ADCSRA & (1 << ADIF) );
-
-  return ADC;
+void setVolume(char clk, char rst, char volume, char mute) {
+  uint8_t step = volumeToStep(volume);
+  potWrite(clk, rst, step, step, mute);
 }
-void handleVolume(uint8_t source_, uint8_t mute_, char* music_title_) {
-  char volume = round(readADC(0) / 1023. * 100.);
 
-  setVolume(PD2, PD3, volume, mute_);
-  setVolume(PD5, PD7, volume, mute_);
+/**
+ * Last written state of a digital potentiometer
+*/
+typedef struct {
+  char clk;      // The clock pin
+  char rst;      // The reset pin
+  uint8_t step;  // Wiper step, 0xFF before the first write
+  uint8_t mute;  // Mute signal
+} Pot;
+Pot pot_stereo = {PD2, PD3, 0xFF, 0};
+Pot pot_mono = {PD5, PD7, 0xFF, 0};
+
+// Max wiper steps per potUpdate() call, 0 jumps straight to the target
+#ifndef VOLUME_RAMP_STEP
+#define VOLUME_RAMP_STEP 2
+#endif
+// Volume knob reading hysteresis, in 10 bit ADC counts
+#ifndef VOLUME_HYSTERESIS
+#define VOLUME_HYSTERESIS 3
+#endif
 
-  // Set the digital potentiometer values based on the pot value
-  // Update the LCD based on the info from the pot and from the stored title
-  if (menuGet() == Stereo) {
-    uint8_t dt[] = {music_title_, volume, mute_, source_};
-    menuUpdateDynamic(dt);
+/**
+ * Moves the potentiometer toward the target, only writing it on change
+ * The wiper moves by at most VOLUME_RAMP_STEP steps per call, to avoid zipper noise
+ * @param pot The potentiometer
+ * @param target The target wiper step
+ * @param mute Mute signal, applied right away
+*/
+void potUpdate(Pot* pot, uint8_t target, uint8_t mute) {
+  if (pot->step == target && pot->mute == mute)
+    return;
+
+  uint8_t step = target;
+  if (VOLUME_RAMP_STEP && pot->step != 0xFF) {
+    if (target > pot->step + VOLUME_RAMP_STEP)
+      step = pot->step + VOLUME_RAMP_STEP;
+    else if (target + VOLUME_RAMP_STEP < pot->step)
+      step = pot->step - VOLUME_RAMP_STEP;
   }
+
+  potWrite(pot->clk, pot->rst, step, step, mute);
+  pot->step = step;
+  pot->mute = mute;
 }
+uint16_t volume_adc = 0xFFFF; // Volume knob reading after hysteresis
+uint8_t volume_level = 0; // Current volume %, set by the knob or the host
+/**
+ * Applies the volume to the digital potentiometers
+ * The volume follows the knob when it moves, and keeps the value set by the host otherwise
+*/
+void handleVolume(uint8_t mute_) {
+  PROF_BEGIN(PROF_VOLUME);
 
-char last_fan = 0; // Store the last FAN tach state
-void handleFan(float* fan_rpm_period_) {
-  // If the fan rpm is too low and the TIM1 overflows
-  if (TIFR & (1 << TOV1)) {
-    TIFR = (1 << TOV1); // Reset the flag
+  // Ignore the ADC jitter around the last reading
+  uint16_t adc = adcGet(0);
+  uint16_t last_adc = volume_adc;
+  if (volume_adc == 0xFFFF || adc > volume_adc + VOLUME_HYSTERESIS || adc + VOLUME_HYSTERESIS < volume_adc)
+    volume_adc = adc;
+  // Snap to the ends so full scale stays reachable
+  if (adc <= VOLUME_HYSTERESIS) volume_adc = 0;
+  if (adc >= 1023 - VOLUME_HYSTERESIS) volume_adc = 1023;
 
-    *fan_rpm_period_ = 1; // Set the period to an invalid value
-  }
+  if (volume_adc != last_adc)
+    volume_level = fixedScaleU10(volume_adc, 100);
 
-  // Calculate the fan rpm using the timer
-  if (__RE(PINB, PB0, last_fan)) {
-    // Calculate the period
-    *fan_rpm_period_ = TCNT1 * 1.28e-4; // 1.28e-4 is calculated using the prescaler value and F_CPU
+  // Set the digital potentiometer values based on the pot value
+  uint8_t step = volumeToStep(volume_level);
+  potUpdate(&pot_stereo, step, mute_);
+  potUpdate(&pot_mono, step, mute_);
 
-    // Reset the TIM1 counter
-    TCNT1 = 0;
-  }
-  last_fan = PINB & (1 << PB0);
+  PROF_END(PROF_VOLUME, 500);
+}
 
-  // Read the temp from the LM335
-  uint16_t temp_read = readADC(1);
+// Fan speed controller gains, Q8.8 PWM steps per rpm (per update for KI/KD)
+#ifndef FAN_PID_KP
+#define FAN_PID_KP Q8_8(0.02)
+#endif
+#ifndef FAN_PID_KI
+#define FAN_PID_KI Q8_8(0.004)
+#endif
+#ifndef FAN_PID_KD
+#define FAN_PID_KD Q8_8(0.01)
+#endif
+Pid fan_pid = PID(FAN_PID_KP, FAN_PID_KI, FAN_PID_KD, 0, 255);
+uint8_t fan_temp = 0; // Last measured temperature, C
+/**
+ * Regulates the fan speed based on the temperature
+ * @param fan_rpm_ Filled with the measured fan speed
+ * @param fan_rpm_min_ The fan speed at 0C
+ * @note Must be called at a fixed rate, the controller gains depend on it
+*/
+void handleFan(uint16_t* fan_rpm_, uint16_t fan_rpm_min_) {
+  PROF_BEGIN(PROF_FAN);
 
-  // Calculate the temperature
-  uint16_t temp = (float)temp_read / 1023. * 5000. * 0.01;
+  // Get the fan speed measured by the tach sampler
+  *fan_rpm_ = tachGetRpm();
 
-  // If the fan menu is displayed, fill in the data
-  if (menuGet() == Fan) {
-    uint8_t dt[] = {temp, *fan_rpm_period_};
-    menuUpdateDynamic(dt);
-  }
+  // Read the filtered temperature from the LM335
+  q8_8_t temp = tempUpdate();
+  if (temp < 0)
+    temp = 0;
+  fan_temp = satU8(q88ToInt(temp));
 
-  // Calculate the target fan rpm
-  uint16_t fan_rpm_target = (float)temp / (float)FAN_TEMP_MAX * (float)(FAN_RPM_MAX-FAN_RPM_MIN) + (float)FAN_RPM_MIN;
-  
-  // Calculate the rpm error
-  int16_t fan_rpm_error = (float)fan_rpm_target - (1. / *fan_rpm_period_ * 60.);
-  lcdGoto(0,3);
+  // Calculate the target fan rpm, with the sub degree resolution of the temperature
+  uint16_t fan_rpm_target = (uint32_t)temp * (FAN_RPM_MAX - fan_rpm_min_) / (FAN_TEMP_MAX << 8) + fan_rpm_min_;
+  if (fan_rpm_target > FAN_RPM_MAX)
+    fan_rpm_target = FAN_RPM_MAX;
 
-  // Set the fan PWM
-  OCR0 = 127 + CLAMP(fan_rpm_error, 125, 127);
-}
+  // Feedforward: the PWM expected to give the target speed, assuming the speed is proportional to the duty cycle
+  int16_t fan_pwm_ff = q1616MulInt(Q16_16(255. / FAN_RPM_MAX), fan_rpm_target);
 
-// Flags used to detect rising edges on buttons
-char last_menu = 0; // Store the last MENU button state
-char last_bpm = 0; // Store the last BP- button state
-char last_bpp = 0; // Store the last BP+ button state
-char last_mute = 0; // Store the last MUTE button state
-void handleButtons(uint8_t* source_, uint8_t* effects_, uint8_t* mute_) {
-  // Menu button ========================================
-  if (__RE(PINB, PB2, last_menu)) {
-    // Go to the next menu and update on button press
-    menuNext();
-    menuUpdateStatic();
-
-    if (menuGet() == Effects) menuUpdateDynamic(effects_);
-  }
-  last_menu = PINB & 1 << PB2;
-
-  // BP- ================================================
-  if (__RE(PINB, PB5, last_bpm)) {
-    switch (menuGet()) {
-      // Toggle the source
-      case Stereo: {
-        *source_ = !(*source_);
-
-        {
-          uint8_t dt[] = {*source_};
-          menuUpdateDynamic(dt);
-        }
-        break;
-      }
+  // Set the fan PWM, the PID only corrects the feedforward error
+  OCR0 = pidUpdate(&fan_pid, fan_rpm_target, *fan_rpm_, fan_pwm_ff);
 
-      // Toggle the Dist effect
-      case Effects: {
-        if (*effects_ & 0x02)
-          *effects_ &= ~0x02;
-        else
-          *effects_ |= 0x02;
+  PROF_END(PROF_FAN, 500);
+}
 
-        {
-          uint8_t dt[] = {*effects_};
-          menuUpdateDynamic(dt);
-        }
+// Step of the minimum fan speed setting
+#ifndef FAN_RPM_STEP
+#define FAN_RPM_STEP 100
+#endif
+/**
+ * Applies the button events to the state and the menus
+ * @note Buttons are debounced by buttonsSample(), from the tick interrupt
+*/
+void handleButtons(uint8_t* source_, uint8_t* effects_, uint8_t* mute_, uint16_t* fan_rpm_min_) {
+  PROF_BEGIN(PROF_BUTTONS);
+
+  uint8_t event;
+  while ((event = buttonsGetEvent()) != BUTTON_NONE) {
+    uint8_t type = BUTTON_EVENT_TYPE(event);
+    uint8_t button = BUTTON_EVENT_BUTTON(event);
+
+    switch (button) {
+      // Menu button ========================================
+      case BUTTON_MENU: {
+        if (type != BUTTON_PRESS) break;
+
+        // Go to the next menu and update on button press
+        menuNext();
+        menuUpdateStatic();
         break;
       }
-    }
-  }
-  last_bpm = PINB & 1 << PB5;
-
-  // BP+ ================================================
-  if (__RE(PINB, PB6, last_bpp)) {
-    switch (menuGet()) {
-      // Toggle the source
-      case Stereo: {
-        *source_ = !(*source_);
-
-        {
-          uint8_t dt[] = {*source_};
-          menuUpdateDynamic(dt);
+
+      // BP- / BP+ ==========================================
+      case BUTTON_MINUS:
+      case BUTTON_PLUS: {
+        uint8_t plus = button == BUTTON_PLUS;
+
+        switch (menuGet()) {
+          // Toggle the source
+          case Stereo: {
+            if (type == BUTTON_PRESS)
+              *source_ = !(*source_);
+            break;
+          }
+
+          // Toggle the Bass (BP+) or Dist (BP-) effect
+          case Effects: {
+            if (type != BUTTON_PRESS) break;
+
+            *effects_ ^= plus ? 0x01 : 0x02;
+            break;
+          }
+
+          // Step the minimum fan speed, holding the button repeats
+          case Fan: {
+            if (type != BUTTON_PRESS && type != BUTTON_REPEAT) break;
+
+            if (plus && *fan_rpm_min_ + FAN_RPM_STEP <= FAN_RPM_MAX)
+              *fan_rpm_min_ += FAN_RPM_STEP;
+            if (!plus && *fan_rpm_min_ >= FAN_RPM_STEP)
+              *fan_rpm_min_ -= FAN_RPM_STEP;
+            break;
+          }
         }
         break;
       }
 
-      // Toggle the Bass effect
-      case Effects: {
-        if (*effects_ & 0x01)
-          *effects_ &= ~0x01;
-        else
-          *effects_ |= 0x01;
-
-        {
-          uint8_t dt[] = {*effects_};
-          menuUpdateDynamic(dt);
-        }
+      // Mute button ========================================
+      case BUTTON_MUTE: {
+        // Toggle the mute state
+        if (type == BUTTON_PRESS)
+          *mute_ = !(*mute_);
         break;
       }
     }
   }
-  last_bpp = PINB & (1 << PB6);
 
-  // Mute button ========================================
-  if (__RE(PINC, PC1, last_mute)) {
-    // Toggle the mute state
-    *mute_ = !(*mute_);
-  }
-  last_mute = PINC & 1 << PC1;
+  PROF_END(PROF_BUTTONS, 200);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+/*
+ * hal.h
+ *
+ * Created: 17/10/2026 00:30:15
+ * Author : agent
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+// Hardware abstraction layer
+// The drivers use the ATmega32 registers (PORTx, ADCSRA, UDR...), the ISR()
+// macro and the avr-libc delay/atomic/sleep helpers through this header only.
+// - On the target, it is avr-libc itself.
+// - With NATIVE defined (see [env:native] in platformio.ini), the registers are
+//   plain variables driven by the simulated peripherals of hal_native.h, so the
+//   application logic builds and runs on Linux.
+// Constant strings and tables are kept in flash with PROGMEM/PSTR() and read
+// with the pgm_read_ helpers, on the native build they are plain memory.
+
+#ifdef NATIVE
+#include "hal_native.h"
+#else
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <util/atomic.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+
+/**
+ * Called by the drivers while they wait for an interrupt to make progress
+ * @note Does nothing on the target, runs the simulated peripherals on the native build
+*/
+#define halIdle()
+#endif
+
+#endif
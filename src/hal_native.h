@@ -0,0 +1,256 @@
+/*
+ * hal_native.h
+ *
+ * Created: 17/10/2026 00:30:15
+ * Author : agent
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef HAL_NATIVE_H_
+#define HAL_NATIVE_H_
+
+// Simulated ATmega32 for the native build, see hal.h
+// Only the parts used by the firmware are modeled:
+// - TIM0 overflows (Fast PWM /8), TIM1 Normal mode /8 with OCR1A, TIM2 CTC /8
+// - ADC conversions, the result is taken from hal_adc_input
+// - USART RX, bytes given to halSimReceive() raise the RXC interrupt, one per
+//   frame time at the UBRR baud rate
+// - USART TX, one byte per step, given to hal_tx_hook, then TXC
+// - EEPROM, reads are immediate and writes take HAL_SIM_EEPROM_WRITE_US
+// Time only moves forward in halSimStep(), called through halIdle() and sleep_cpu().
+
+// Registers ==================================================================
+// Each port is PINx, DDRx, PORTx at consecutive addresses, as on the AVR
+// (softwareserial.h reaches PORTx through the DDRx pointer). PINx are the
+// inputs, set by the simulation.
+volatile uint8_t hal_port_a[3], hal_port_b[3], hal_port_c[3], hal_port_d[3];
+#define PINA hal_port_a[0]
+#define DDRA hal_port_a[1]
+#define PORTA hal_port_a[2]
+#define PINB hal_port_b[0]
+#define DDRB hal_port_b[1]
+#define PORTB hal_port_b[2]
+#define PINC hal_port_c[0]
+#define DDRC hal_port_c[1]
+#define PORTC hal_port_c[2]
+#define PIND hal_port_d[0]
+#define DDRD hal_port_d[1]
+#define PORTD hal_port_d[2]
+volatile uint8_t ADCSRA, ADMUX, SFIOR;
+volatile uint16_t ADC;
+volatile uint8_t TCCR0, TCNT0, OCR0;
+volatile uint8_t TCCR1A, TCCR1B;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2, TCNT2, OCR2, ASSR;
+volatile uint8_t TIFR, TIMSK;
+volatile uint8_t UBRRH, UBRRL, UCSRA = 0x20, UCSRB, UCSRC, UDR; // UDRE stays set, halSimStep() sends the TX bytes
+volatile uint8_t MCUCR, GICR, SREG;
+volatile uint16_t EEAR;
+volatile uint8_t EECR;
+#define EEDR (*halSimEedr()) // Reading EEDR after setting EERE gives the EEPROM byte
+
+// Register bits ==============================================================
+enum { PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7 };
+enum { PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7 };
+enum { PC0, PC1, PC2, PC3, PC4, PC5, PC6, PC7 };
+enum { PD0, PD1, PD2, PD3, PD4, PD5, PD6, PD7 };
+enum { MUX0, MUX1, MUX2, MUX3, MUX4, ADLAR, REFS0, REFS1 };
+enum { ADPS0, ADPS1, ADPS2, ADIE, ADIF, ADATE, ADSC, ADEN };
+enum { CS00, CS01, WGM01, COM00, COM01, WGM00, FOC0 };
+enum { WGM10, WGM11, FOC1B, FOC1A, COM1B0, COM1B1, COM1A0, COM1A1 };
+enum { CS10, CS11, CS12, WGM12, WGM13, ICES1 = 6, ICNC1 };
+enum { CS20, CS21, CS22, WGM21, COM20, COM21, WGM20, FOC2 };
+enum { TOIE0, OCIE0, TOIE1, OCIE1B, OCIE1A, TICIE1, TOIE2, OCIE2 };
+enum { TOV0, OCF0, TOV1, OCF1B, OCF1A, ICF1, TOV2, OCF2 };
+enum { MPCM, U2X, PE, DOR, FE, UDRE, TXC, RXC };
+enum { TXB8, RXB8, UCSZ2, TXEN, RXEN, UDRIE, TXCIE, RXCIE };
+enum { UCPOL, UCSZ0, UCSZ1, USBS, UPM0, UPM1, UMSEL, URSEL };
+enum { EERE, EEWE, EEMWE, EERIE };
+
+// avr-libc replacements ======================================================
+#define ISR(vector) void vector(void)
+#define sei()
+#define cli()
+#define _delay_us(us)
+#define _delay_ms(ms)
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for (uint8_t __atomic_once = 1; __atomic_once; __atomic_once = 0)
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC 1
+#define set_sleep_mode(mode) (hal_sleep_mode = (mode))
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() halSimSleep()
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_ptr(address) (*(const void* const*)(address))
+#define memcpy_P(dest, src, n) memcpy(dest, src, n)
+#define strcmp_P(s1, s2) strcmp(s1, s2)
+#define strncmp_P(s1, s2, n) strncmp(s1, s2, n)
+
+// Interrupt vectors, defined by the drivers that use them
+void TIMER0_OVF_vect(void) __attribute__((weak));
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER2_COMP_vect(void) __attribute__((weak));
+void ADC_vect(void) __attribute__((weak));
+void USART_RXC_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void USART_TXC_vect(void) __attribute__((weak));
+void EE_RDY_vect(void) __attribute__((weak));
+
+// Simulation =================================================================
+// The CPU clock, for the USART frame time. Same value as main.c
+#ifndef F_CPU
+#define F_CPU 8000000
+#endif
+#ifndef HAL_SIM_STEP_US
+#define HAL_SIM_STEP_US 16 // Simulated time per halSimStep()
+#endif
+#ifndef HAL_SIM_EEPROM_WRITE_US
+#define HAL_SIM_EEPROM_WRITE_US 8500 // Programming time of one EEPROM byte
+#endif
+
+uint16_t hal_adc_input[8];     // Value converted by each ADC channel
+uint32_t hal_time_us = 0;      // Simulated time since the start
+uint16_t hal_tim0_us = 0;      // Time since the last TIM0 overflow
+uint16_t hal_tim2_us = 0;      // Time since the last TIM2 compare match
+char hal_rx_buf[256];          // Bytes waiting to be received by the USART
+uint8_t hal_rx_head = 0, hal_rx_tail = 0;
+uint16_t hal_rx_us = 0;        // Time since the last received byte
+void (*hal_tx_hook)(uint8_t byte_) = NULL; // Receives the bytes sent by the USART
+uint8_t hal_sleep_mode = SLEEP_MODE_IDLE; // Mode set by set_sleep_mode()
+uint8_t hal_eeprom[1024] = {[0 ... 1023] = 0xFF}; // EEPROM content, erased
+uint8_t hal_eedr;              // EEDR register
+uint16_t hal_eeprom_us = 0;    // Time since the start of the EEPROM write
+uint32_t hal_eeprom_writes = 0; // Number of programmed bytes
+
+/**
+ * Queues a byte to be received by the simulated USART
+*/
+void halSimReceive(char byte_) {
+  hal_rx_buf[hal_rx_head++] = byte_;
+}
+
+/**
+ * Gives the EEDR register, loaded with the EEPROM byte at EEAR if a read was started
+*/
+volatile uint8_t* halSimEedr() {
+  if (EECR & (1 << EERE)) {
+    EECR &= ~(1 << EERE);
+    hal_eedr = hal_eeprom[EEAR & 0x3FF];
+  }
+  return &hal_eedr;
+}
+
+/**
+ * Moves the simulated time forward by HAL_SIM_STEP_US and runs the peripherals
+ * The timers all count at 1MHz (F_CPU/8 at 8MHz)
+*/
+void halSimStep() {
+  hal_time_us += HAL_SIM_STEP_US;
+
+  // TIM0, Fast PWM overflow every 256 counts
+  hal_tim0_us += HAL_SIM_STEP_US;
+  if (hal_tim0_us >= 256) {
+    hal_tim0_us -= 256;
+    TIFR |= (1 << TOV0);
+    if ((TIMSK & (1 << TOIE0)) && TIMER0_OVF_vect) {
+      TIFR &= ~(1 << TOV0);
+      TIMER0_OVF_vect();
+    }
+  }
+
+  // TIM1, Normal mode with the OCR1A compare match
+  if (TCCR1B & 0x07) {
+    uint16_t before = TCNT1;
+    TCNT1 += HAL_SIM_STEP_US;
+    if ((uint16_t)(OCR1A - before - 1) < HAL_SIM_STEP_US) {
+      TIFR |= (1 << OCF1A);
+      if ((TIMSK & (1 << OCIE1A)) && TIMER1_COMPA_vect) {
+        TIFR &= ~(1 << OCF1A);
+        TIMER1_COMPA_vect();
+      }
+    }
+  }
+
+  // TIM2, CTC mode
+  if (TCCR2 & 0x07) {
+    hal_tim2_us += HAL_SIM_STEP_US;
+    while (hal_tim2_us > OCR2) {
+      hal_tim2_us -= OCR2 + 1;
+      if ((TIMSK & (1 << OCIE2)) && TIMER2_COMP_vect)
+        TIMER2_COMP_vect();
+    }
+  }
+
+  // ADC, one conversion per step
+  if ((ADCSRA & (1 << ADEN)) && (ADCSRA & (1 << ADSC))) {
+    ADCSRA &= ~(1 << ADSC);
+    ADC = hal_adc_input[ADMUX & 0x07] & 0x3FF;
+    ADCSRA |= (1 << ADIF);
+    if ((ADCSRA & (1 << ADIE)) && ADC_vect) {
+      ADCSRA &= ~(1 << ADIF);
+      ADC_vect();
+    }
+  }
+
+  // USART RX
+  // A 10 bit frame takes 10 * 16 * (UBRR + 1) CPU cycles
+  if (hal_rx_us < UINT16_MAX - HAL_SIM_STEP_US)
+    hal_rx_us += HAL_SIM_STEP_US;
+  uint32_t frame_us = 160UL * ((UBRRH << 8 | UBRRL) + 1) / (F_CPU / 1000000UL);
+  if ((UCSRB & (1 << RXEN)) && hal_rx_head != hal_rx_tail && hal_rx_us >= frame_us) {
+    hal_rx_us = 0;
+    UDR = hal_rx_buf[hal_rx_tail++];
+    if ((UCSRB & (1 << RXCIE)) && USART_RXC_vect)
+      USART_RXC_vect();
+  }
+
+  // USART TX, the UDRE interrupt only stays enabled if it wrote a byte
+  if ((UCSRB & (1 << TXEN)) && (UCSRB & (1 << UDRIE)) && USART_UDRE_vect) {
+    USART_UDRE_vect();
+    if ((UCSRB & (1 << UDRIE)) && hal_tx_hook != NULL)
+      hal_tx_hook(UDR);
+    UCSRA |= (1 << TXC);
+  }
+  if ((UCSRB & (1 << TXCIE)) && (UCSRA & (1 << TXC)) && USART_TXC_vect) {
+    UCSRA &= ~(1 << TXC);
+    USART_TXC_vect();
+  }
+
+  // EEPROM, the EE_RDY interrupt fires on every step while no write is running
+  if (EECR & (1 << EEWE)) {
+    hal_eeprom_us += HAL_SIM_STEP_US;
+    if (hal_eeprom_us >= HAL_SIM_EEPROM_WRITE_US) {
+      hal_eeprom_us = 0;
+      hal_eeprom[EEAR & 0x3FF] = hal_eedr;
+      hal_eeprom_writes++;
+      EECR &= ~(1 << EEWE | 1 << EEMWE);
+    }
+  }
+  if ((EECR & (1 << EERIE)) && !(EECR & (1 << EEWE)) && EE_RDY_vect)
+    EE_RDY_vect();
+}
+
+/**
+ * Sleeps until the next simulation step
+ * Entering the ADC noise reduction mode starts a conversion, the clocks are not stopped
+*/
+void halSimSleep() {
+  if (hal_sleep_mode == SLEEP_MODE_ADC && (ADCSRA & (1 << ADEN)))
+    ADCSRA |= (1 << ADSC);
+  halSimStep();
+}
+
+/**
+ * Called by the drivers while they wait for an interrupt to make progress
+*/
+#define halIdle() halSimStep()
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * level.h
+ *
+ * Created: 17/10/2026 00:47:31
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include "fixed.h"
+
+#ifndef LEVEL_H_
+#define LEVEL_H_
+
+// Audio level meter
+// LEVEL_CHANNEL carries the audio envelope (0V = silence) and is listed several
+// times in ADC_CHANNEL_LIST to be sampled at a few kHz. The ADC interrupt gives
+// each sample to levelSample(), which only keeps the block peak and sum of
+// squares on 8 bits. levelUpdate() then turns them into the displayed levels
+// (0-255), which fall back slowly after a loud block.
+
+#ifndef LEVEL_CHANNEL
+#define LEVEL_CHANNEL 3
+#endif
+// Samples per RMS block, as a power of 2 (max 16)
+#ifndef LEVEL_BLOCK_LOG2
+#define LEVEL_BLOCK_LOG2 8
+#endif
+// Displayed level lost per levelUpdate()
+#ifndef LEVEL_RMS_DECAY
+#define LEVEL_RMS_DECAY 8
+#endif
+#ifndef LEVEL_PEAK_DECAY
+#define LEVEL_PEAK_DECAY 4
+#endif
+// Peak considered as clipping, 0 disables the warning
+#ifndef LEVEL_CLIP
+#define LEVEL_CLIP 250
+#endif
+// levelUpdate() calls the clip warning stays on
+#ifndef LEVEL_CLIP_HOLD
+#define LEVEL_CLIP_HOLD 25
+#endif
+
+// Running block, only used by the ISR
+uint32_t level_sum = 0;
+uint16_t level_count = 0;
+// Results of the ISR
+volatile uint8_t level_block_peak = 0;     // Peak since the last levelUpdate()
+volatile uint16_t level_mean_square = 0;   // Mean square of the last block
+
+// Displayed levels
+uint8_t level_rms = 0;  // RMS level, with decay
+uint8_t level_peak = 0; // Peak level, with decay
+uint8_t level_clip = 0; // Non zero while the clip warning is on
+
+/**
+ * Adds one sample of the envelope, called from the ADC interrupt
+ * @param sample The 10 bit conversion result
+*/
+void levelSample(uint16_t sample) {
+  uint8_t x = sample >> 2;
+  if (x > level_block_peak)
+    level_block_peak = x;
+
+  level_sum += (uint16_t)x * x;
+  if (++level_count >= (1U << LEVEL_BLOCK_LOG2)) {
+    level_mean_square = level_sum >> LEVEL_BLOCK_LOG2;
+    level_sum = 0;
+    level_count = 0;
+  }
+}
+
+/**
+ * Moves a displayed level toward a new one
+ * Rises at once, falls by at most decay
+*/
+uint8_t levelDecay(uint8_t shown, uint8_t level, uint8_t decay) {
+  if (level >= shown)
+    return level;
+  return shown - level > decay ? shown - decay : level;
+}
+
+/**
+ * Updates the displayed levels and the clip warning
+ * @note Must be called at a fixed rate, the decays depend on it
+*/
+void levelUpdate() {
+  uint8_t peak;
+  uint16_t mean_square;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    peak = level_block_peak;
+    level_block_peak = 0;
+    mean_square = level_mean_square;
+  }
+
+  level_rms = levelDecay(level_rms, isqrt16(mean_square), LEVEL_RMS_DECAY);
+  level_peak = levelDecay(level_peak, peak, LEVEL_PEAK_DECAY);
+
+  if (LEVEL_CLIP && peak >= LEVEL_CLIP)
+    level_clip = LEVEL_CLIP_HOLD;
+  else if (level_clip)
+    level_clip--;
+}
+
+#endif
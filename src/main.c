@@ -11,92 +11,372 @@
 #define FAN_RPM_MIN 1200
 #define FAN_RPM_MAX 6000
 #define FAN_TEMP_MAX 80
-#define LCD_USE_SOFTWARESERIAL
+#define LCD_USE_SOFTWARESERIAL // Or LCD_USE_USART, to share the hardware USART with a TXD select pin (see usart.h)
 #define SOFTWARESERIAL_BAUD 19200
 #define MAX_USART_RX 100
+#define HOST_LINE_TIMEOUT 100 // ms without a byte before an unfinished text line or frame is dropped
+#define PROFILE
+#define SETTINGS_VERSION 2
+#define MENU_WIDGETS_MAX 10
 
 // Libs
-#include <avr/io.h>
-#include <util/delay.h>
+#include "hal.h"
 #include <stdint.h>
 #include "gpio.h"
 #include "macros.h"
 #include "LCD.h"
 #include "menu.h"
 #include "usart.h"
+#include "scheduler.h"
+#include "protocol.h"
+#include "settings.h"
+#include "power.h"
+#include "level.h"
+#ifdef BENCH
+#include "bench.h"
+#endif
 
 
-int main() {
-  initGpio();
+// State vars
+uint8_t mute = 0;           // Current mute state
+uint8_t menu = 0;           // Current selected menu
+uint8_t source = 0;         // Current selected source
+uint8_t effects = 0;        // Current effects | bit0 = Bass, bit1 = Dist
+uint16_t fan_rpm = 0;       // Current fan speed
+uint16_t fan_rpm_min = FAN_RPM_MIN; // Fan speed at 0C
+char music_title[65] = {0}; // Current music playing title
+uint8_t telemetry_period = 10; // Telemetry period in 100ms, 0 = off
 
-  // State vars
-  uint8_t mute = 0;           // Current mute state
-  uint8_t menu = 0;           // Current selected menu
-  uint8_t source = 0;         // Current selected source
-  uint8_t effects = 0;        // Current effects | bit0 = Bass, bit1 = Dist
-  float fan_rpm_period = 1;   // Current fan period
-  char music_title[65] = {0}; // Current music playing title
+// Saved settings, bump SETTINGS_VERSION when changing this table
+const Setting settings[] PROGMEM = {
+  SETTING(source),
+  SETTING(effects),
+  SETTING(mute),
+  SETTING(menu),
+  SETTING(fan_rpm_min),
+  SETTING(temp_cal),
+};
+#define SETTINGS_COUNT (sizeof(settings) / sizeof(settings[0]))
 
-  lcdInit(); // Start LCD
-  lcdSetCursor(0); // Hide cursor
+// Menus ======================================
+// Texts, in flash
+const char txt_stereo[] PROGMEM = "[Stereo]";
+const char txt_clip[] PROGMEM = "!";
+const char txt_no_clip[] PROGMEM = " ";
+const char txt_title[] PROGMEM = "Title:";
+const char txt_unknown[] PROGMEM = "Unknown";
+const char txt_volume[] PROGMEM = "Volume:";
+const char txt_mute[] PROGMEM = "MUTE";
+const char txt_source[] PROGMEM = "Source:";
+const char txt_jack[] PROGMEM = "[Jack]";
+const char txt_rca[] PROGMEM = "[RCA ]";
+const char txt_effects[] PROGMEM = "[Effects]";
+const char txt_bass_on[] PROGMEM = " [Bass]";
+const char txt_bass_off[] PROGMEM = "  Bass ";
+const char txt_dist_on[] PROGMEM = " [Dist]";
+const char txt_dist_off[] PROGMEM = "  Dist ";
+const char txt_fan[] PROGMEM = "[Fan]";
+const char txt_temp[] PROGMEM = "T:";
+const char txt_rpm[] PROGMEM = "RPM:";
+const char txt_rpm_min[] PROGMEM = "Min RPM:";
+const char txt_credit_0[] PROGMEM = "G111   2022-2023";
+const char txt_credit_1[] PROGMEM = "Git: Angers-SAE2";
+const char txt_credit_2[] PROGMEM = " Arthur  DUPONT ";
+const char txt_credit_3[] PROGMEM = "  Mael   GADOU  ";
 
-  // Start USB
-  usartInit();
-
-  // Display default menu
-  menuInit(&menu);
-  menuUpdateStatic();
+const Widget menu_stereo[] PROGMEM = {
+  LABEL(0, 0, txt_stereo),
+  BAR(9, 0, 6, 255, &level_rms),
+  TOGGLE(15, 0, 0xFF, &level_clip, txt_clip, txt_no_clip),
+  LABEL(0, 1, txt_title),
+  TEXT(7, 1, LCD_COLS - 7, music_title, txt_unknown),
+  LABEL(0, 2, txt_volume),
+  NUMBER_U8_ALT(8, 2, 3, '%', &volume_level, &mute, txt_mute),
+  BAR(12, 2, 4, 100, &volume_level),
+  LABEL(0, 3, txt_source),
+  TOGGLE(8, 3, 0x01, &source, txt_jack, txt_rca),
+};
+const Widget menu_effects[] PROGMEM = {
+  LABEL(0, 0, txt_effects),
+  TOGGLE(0, 1, 0x01, &effects, txt_bass_on, txt_bass_off),
+  TOGGLE(7, 1, 0x02, &effects, txt_dist_on, txt_dist_off),
+};
+const Widget menu_fan[] PROGMEM = {
+  LABEL(0, 0, txt_fan),
+  LABEL(0, 1, txt_temp),
+  NUMBER_U8(3, 1, 2, 'C', &fan_temp),
+  LABEL(7, 1, txt_rpm),
+  NUMBER_U16(12, 1, 4, 0, &fan_rpm),
+  LABEL(0, 2, txt_rpm_min),
+  NUMBER_U16(12, 2, 4, 0, &fan_rpm_min),
+  BAR(0, 3, LCD_COLS, FAN_RPM_MAX, &fan_rpm),
+};
+const Widget menu_credit[] PROGMEM = {
+  LABEL(0, 0, txt_credit_0),
+  LABEL(0, 1, txt_credit_1),
+  LABEL(0, 2, txt_credit_2),
+  LABEL(0, 3, txt_credit_3),
+};
+// Screens, in the MenuList order
+const MenuScreen menu_screens[MENU_OVERFLOW] PROGMEM = {
+  SCREEN(menu_stereo),
+  SCREEN(menu_effects),
+  SCREEN(menu_fan),
+  SCREEN(menu_credit),
+};
 
-  while (1) {
-    // Music title
-    if (usartCharAvail()) {
-      char rx_buf[MAX_USART_RX+1] = {0};
+// Called from the tick interrupt
+void tickHook() {
+  buttonsSample();
+  #ifdef LCD_USE_USART
+  usartTick();
+  #endif
+}
 
-      size_t i=0;
-      for (; i < MAX_USART_RX; i++) {
-        char rd_char[] = {usartReadChar(), 0};
-        if (rd_char[0] == '\n') break;
+// Called from the ADC interrupt
+void adcHook(uint8_t ch, uint16_t sample) {
+  if (ch == LEVEL_CHANNEL)
+    levelSample(sample);
+}
 
-        strcat(rx_buf, rd_char);
+// Tasks ======================================
+/**
+ * Runs a binary protocol command
+*/
+void hostFrame(ProtoFrame* frame) {
+  switch (frame->type) {
+    case PROTO_TITLE: {
+      uint8_t length = frame->length < sizeof(music_title) - 1 ? frame->length : sizeof(music_title) - 1;
+      memcpy(music_title, frame->payload, length);
+      music_title[length] = '\0';
+      menuTextChanged();
+      break;
+    }
+    case PROTO_VOLUME: {
+      if (frame->length >= 1)
+        volume_level = frame->payload[0] > 100 ? 100 : frame->payload[0];
+      break;
+    }
+    case PROTO_MUTE: {
+      if (frame->length >= 1)
+        mute = frame->payload[0] != 0;
+      break;
+    }
+    case PROTO_SOURCE: {
+      if (frame->length >= 1)
+        source = frame->payload[0] != 0;
+      break;
+    }
+    case PROTO_EFFECTS: {
+      if (frame->length >= 1)
+        effects = frame->payload[0] & 0x03;
+      break;
+    }
+    case PROTO_TELEMETRY_RATE: {
+      if (frame->length >= 1)
+        telemetry_period = frame->payload[0];
+      break;
+    }
+    case PROTO_TEMP_CAL: {
+      if (frame->length >= 6) {
+        temp_cal.offset = frame->payload[0] | frame->payload[1] << 8;
+        temp_cal.gain = frame->payload[2] | frame->payload[3] << 8;
+        temp_cal.coupling = frame->payload[4] | frame->payload[5] << 8;
+        tempCalChanged();
       }
+      uint16_t sum0 = adcGetSum(TEMP_VOLUME_CHANNEL), sum1 = adcGetSum(ADC_QUIET_CHANNEL);
+      q8_8_t temp = tempGet();
+      uint8_t reply[] = {
+        temp_cal.offset & 0xFF, temp_cal.offset >> 8, temp_cal.gain & 0xFF, temp_cal.gain >> 8,
+        temp_cal.coupling & 0xFF, temp_cal.coupling >> 8,
+        sum0 & 0xFF, sum0 >> 8, sum1 & 0xFF, sum1 >> 8, temp & 0xFF, temp >> 8
+      };
+      protoSend(PROTO_TEMP_CAL | PROTO_REPLY, reply, sizeof(reply));
+      break;
+    }
+    case PROTO_STATUS: {
+      uint8_t status[] = {volume_level, mute, source, effects, menu, fan_temp, fan_rpm & 0xFF, fan_rpm >> 8};
+      protoSend(PROTO_STATUS | PROTO_REPLY, status, sizeof(status));
+      break;
+    }
+    case PROTO_GET_TITLE: {
+      protoSend(PROTO_GET_TITLE | PROTO_REPLY, (uint8_t*)music_title, strlen(music_title));
+      break;
+    }
+  }
+}
+
+/**
+ * Runs a text command
+*/
+void hostLine(char* line) {
+  // Music title
+  if (strncmp_P(line, PSTR("cTitle"), 6) == 0 && line[6] == ' ') {
+    strncpy(music_title, line+7, sizeof(music_title) - 1);
+    menuTextChanged();
+  }
+
+  // Profiler readout
+  if (strcmp_P(line, PSTR("cProf")) == 0)
+    profDump();
+  if (strcmp_P(line, PSTR("cProfReset")) == 0)
+    profReset();
+}
 
-      char cmd[] = "cTitle";
-      memcpy(cmd, rx_buf, 7);
-      if (strcmp(cmd, "cTitle")) memcpy(music_title, rx_buf+7, 16);
+uint16_t host_rx_tick = 0; // Tick of the last received byte
+
+void taskHost() {
+  while (usartCharAvail()) {
+    uint8_t byte_ = usartReadChar();
+
+    // A stray byte starts a text line that would hold off the binary frames
+    // forever, and a cut frame would swallow the next commands: drop both
+    // once the host went quiet
+    uint16_t now = tickNow();
+    if ((uint16_t)(now - host_rx_tick) >= HOST_LINE_TIMEOUT) {
+      usartLineReset();
+      protoReset();
     }
+    host_rx_tick = now;
+
+    // Binary frames
+    uint8_t result = protoFeed(byte_, !usartLinePending());
+    if (result == PROTO_FRAME)
+      hostFrame(&proto_frame);
+    if (result != PROTO_IDLE)
+      continue;
+
+    // Text lines
+    char* line = usartLineFeed(byte_);
+    if (line != NULL)
+      hostLine(line);
+  }
+
+  // Profiler readout, one line per run as the TX buffer drains
+  profDumpStep();
+}
 
+void taskButtons() {
+  handleButtons(&source, &effects, &mute, &fan_rpm_min);
 
-    // Buttons ==================================
-    handleButtons(&source, &effects, &mute);
-
-    // Volume ===================================
-    handleVolume(source, mute, music_title);
-	
-    // Fan regulation ===========================
-    handleFan(&fan_rpm_period);
-    
-    // Output the effects values ================
-    if (effects & 0x01) // Bass
-      PORTA |= (1 << PA2);
-    else
-      PORTA &= ~(1 << PA2);
-    
-    if (effects & 0x02) // Dist
-      PORTB |= (1 << PB4);
-    else
-      PORTB &= ~(1 << PB4);
-
-    // Toggle the stereo source =================
-    if (source)
-      PORTD |= 1 << PD4;
-    else
-      PORTD &= ~1 << PD4;
-
-    // Mute led =================================
-    if (mute)
-      PORTB |= (1 << PB7);
-    else
-      PORTB &= ~(1 << PB7);
+  // Output the effects values ================
+  if (effects & 0x01) // Bass
+    PORTA |= (1 << PA2);
+  else
+    PORTA &= ~(1 << PA2);
+  
+  if (effects & 0x02) // Dist
+    PORTB |= (1 << PB4);
+  else
+    PORTB &= ~(1 << PB4);
+
+  // Toggle the stereo source =================
+  if (source)
+    PORTD |= 1 << PD4;
+  else
+    PORTD &= ~(1 << PD4);
+
+  // Mute led =================================
+  if (mute)
+    PORTB |= (1 << PB7);
+  else
+    PORTB &= ~(1 << PB7);
+}
+
+void taskVolume() {
+  handleVolume(mute);
+}
+
+void taskFan() {
+  handleFan(&fan_rpm, fan_rpm_min);
+}
+
+void taskDisplay() {
+  menuUpdateDynamic();
+  lcdFlush();
+}
+
+void taskLevel() {
+  levelUpdate();
+}
+
+void taskSettings() {
+  settingsUpdate();
+}
+
+void taskMarquee() {
+  menuScroll();
+}
+
+/**
+ * Sends a PROTO_TELEMETRY frame every telemetry_period runs, payload (little endian):
+ *   temp C (u8), fan rpm (u16), fan pwm (u8), volume % (u8),
+ *   flags (u8, bit0 mute, bit1 source, bit2 bass, bit3 dist), menu (u8),
+ *   longest loop since the last frame in us (u16), total task overruns (u16),
+ *   CPU load since the last frame in 1/1000 (u16), audio RMS and peak levels (u8)
+ * @note The frame is skipped if the TX buffer cannot take it without waiting
+*/
+uint8_t telemetry_count = 0;
+void taskTelemetry() {
+  if (telemetry_period == 0 || ++telemetry_count < telemetry_period)
+    return;
+  telemetry_count = 0;
+
+  uint16_t load = powerLoad();
+  uint8_t payload[] = {
+    fan_temp, fan_rpm & 0xFF, fan_rpm >> 8, OCR0, volume_level,
+    mute | source << 1 | (effects & 0x03) << 2, menu,
+    sched_loop_max & 0xFF, sched_loop_max >> 8, sched_overruns & 0xFF, sched_overruns >> 8,
+    load & 0xFF, load >> 8, level_rms, level_peak
+  };
+  if (usartTxFree() < sizeof(payload) + 4)
+    return;
+  protoSend(PROTO_TELEMETRY, payload, sizeof(payload));
+  sched_loop_max = 0;
+}
+
+// Task table, by priority. Budgets are in us
+Task tasks[] = {
+  TASK(taskButtons,  100, 200),
+  TASK(taskHost,     100, 500),
+  TASK(taskVolume,    50, 500),
+  TASK(taskFan,        4, 500),
+  TASK(taskLevel,     25, 200),
+  TASK(taskDisplay,   20, 2000),
+  TASK(taskMarquee,    4, 500),
+  TASK(taskTelemetry, 10, 500),
+  TASK(taskSettings,  10, 500),
+};
+#define TASK_COUNT (sizeof(tasks) / sizeof(tasks[0]))
+
+
+int main() {
+  initGpio();
+  sei(); // The LCD and USART drivers are interrupt driven
+
+  // Start USB, before the LCD which can share it
+  usartInit();
+
+  lcdInit(); // Start LCD
+  lcdSetCursor(0); // Hide cursor
+
+  // Restore the saved settings
+  settingsInit(settings, SETTINGS_COUNT);
+  if (menu >= MENU_OVERFLOW) menu = 0;
+  if (fan_rpm_min > FAN_RPM_MAX) fan_rpm_min = FAN_RPM_MIN;
+
+  // Display the menu
+  menuInit(&menu, menu_screens);
+  profReset();
+  menuUpdateStatic();
+
+  #ifdef BENCH
+  benchRun(tasks, TASK_COUNT, &mute, &fan_rpm_min);
+  #endif
+
+  while (1) {
+    schedRun(tasks, TASK_COUNT);
+    powerIdle(tasks, TASK_COUNT);
   }
 
   return 0;
@@ -7,8 +7,9 @@
 
 #include <stdint.h>
 #include <string.h>
-#include <stdio.h>
 #include "LCD.h"
+#include "format.h"
+#include "profiler.h"
 
 #ifndef MENU_H_
 #define MENU_H_
@@ -20,12 +21,72 @@ enum MenuList {
   Credit,
   MENU_OVERFLOW
 };
+// Widget kinds, see Widget
+enum WidgetType {
+  WIDGET_LABEL,  // Fixed text, drawn with the screen
+  WIDGET_U8,     // uint8_t number
+  WIDGET_U16,    // uint16_t number
+  WIDGET_TOGGLE, // One of two texts, picked by bits of a uint8_t
+  WIDGET_TEXT,   // CString, scrolled when longer than its field
+  WIDGET_BAR     // Bar graph of a uint8_t or uint16_t, with custom glyphs
+};
+
+/**
+ * One element of a screen, bound to a state variable
+ * The renderer redraws it only when the bound value changes.
+ * All the texts are in flash (see PROGMEM).
+*/
+typedef struct {
+  uint8_t type;       // WidgetType
+  uint8_t x, y;       // Position of the first character
+  uint8_t width;      // U8/U16: min number of digits, TEXT/BAR: field width
+  uint8_t arg;        // U8/U16: suffix character (0 for none), TOGGLE: bit mask, BAR: size of the variable
+  uint16_t max;       // BAR: value of a full bar
+  const void* value;  // The bound variable, NULL for a LABEL
+  const uint8_t* alt; // U8/U16: when not NULL and true, text is shown instead of the number
+  const char* text;   // LABEL: the text, U8/U16: the alt text, TOGGLE: the set text, TEXT: shown when empty
+  const char* text_off; // TOGGLE: the cleared text
+} Widget;
+
+#define LABEL(x, y, text) {WIDGET_LABEL, x, y, 0, 0, 0, NULL, NULL, text, NULL}
+#define NUMBER_U8(x, y, width, suffix, var) {WIDGET_U8, x, y, width, suffix, 0, var, NULL, NULL, NULL}
+#define NUMBER_U16(x, y, width, suffix, var) {WIDGET_U16, x, y, width, suffix, 0, var, NULL, NULL, NULL}
+#define NUMBER_U8_ALT(x, y, width, suffix, var, alt, alt_text) {WIDGET_U8, x, y, width, suffix, 0, var, alt, alt_text, NULL}
+#define TOGGLE(x, y, mask, var, text_on, text_off) {WIDGET_TOGGLE, x, y, 0, mask, 0, var, NULL, text_on, text_off}
+#define TEXT(x, y, width, var, text_empty) {WIDGET_TEXT, x, y, width, 0, 0, var, NULL, text_empty, NULL}
+#define BAR(x, y, width, max, var) {WIDGET_BAR, x, y, width, sizeof(*(var)), max, var, NULL, NULL, NULL}
+
+/**
+ * A screen, as a table of widgets in flash
+*/
+typedef struct {
+  const Widget* widgets;
+  uint8_t count;
+} MenuScreen;
+// Max number of widgets per screen
+#ifndef MENU_WIDGETS_MAX
+#define MENU_WIDGETS_MAX 8
+#endif
+
+// The count is checked at build time, a screen over MENU_WIDGETS_MAX does not compile
+#define SCREEN_COUNT(widgets) (sizeof(widgets) / sizeof(widgets[0]))
+#define SCREEN(widgets) {widgets, SCREEN_COUNT(widgets) + 0 * sizeof(struct { \
+    _Static_assert(SCREEN_COUNT(widgets) <= MENU_WIDGETS_MAX, #widgets " has more than MENU_WIDGETS_MAX widgets"); \
+    char c; \
+  })}
+#define MENU_KEY_INVALID 0xFFFFFFFF
+
 uint8_t* menu_pt;
+const MenuScreen* menu_screens_pt; // Screen table in flash, indexed by MenuList
+// Value of the bound variable of each widget of the current screen when it was drawn
+uint32_t menu_keys[MENU_WIDGETS_MAX];
 /**
- * Set the container for the menu counter
+ * Set the container for the menu counter and the screen table
+ * @param screens The screens in flash, one per MenuList entry, in the same order
 */
-void menuInit(uint8_t* target_pt) {
+void menuInit(uint8_t* target_pt, const MenuScreen* screens) {
   menu_pt = target_pt;
+  menu_screens_pt = screens;
 }
 /**
  * Get the current selected menu
@@ -38,7 +99,7 @@ uint8_t menuGet() {
  * @note You must update the menu manually.
 */
 void menuSet(uint8_t index) {
-  if (index > 0 && index < MENU_OVERFLOW)
+  if (index < MENU_OVERFLOW)
     *menu_pt = index;
 }
 /**
@@ -60,118 +121,246 @@ void menuNext() {
     *menu_pt = 0;
 }
 /**
- * Prints the static parts of the current menu
- * Call this each time you want to change menu
+ * Reads the current screen from flash
 */
-void menuUpdateStatic() {
-  lcdClear();
-  
-  // Print the menu content
-  char l1[17] = {0};
-  char l2[17] = {0};
-  char l3[17] = {0};
-  char l4[17] = {0};
-  switch (*menu_pt) {
-    case Stereo: {
-      strcat(l1, "[Stereo]");
-      strcat(l1, "Title: Unknown  ");
-      strcat(l3, "Volume: 000%%  ");
-      strcat(l4, "Source: [RCA]");
-      break;
-    }
+MenuScreen menuScreen() {
+  MenuScreen screen;
+  memcpy_P(&screen, &menu_screens_pt[*menu_pt], sizeof(screen));
+  return screen;
+}
+/**
+ * Forces all the widgets of the current screen to be redrawn by menuUpdateDynamic()
+*/
+void menuInvalidate() {
+  for (uint8_t i = 0; i < MENU_WIDGETS_MAX; i++)
+    menu_keys[i] = MENU_KEY_INVALID;
+}
 
-    case Effects: {
-      strcat(l1, "[Effects]");
-      break;
-    }
+// Blank cells between the end and the start of a scrolling text
+#ifndef MENU_SCROLL_GAP
+#define MENU_SCROLL_GAP 3
+#endif
+// Scroll steps a text stays still at its start
+#ifndef MENU_SCROLL_HOLD
+#define MENU_SCROLL_HOLD 4
+#endif
 
-    case Fan: {
-      strcat(l1, "[Fan]");
-      strcat(l2, "T:   C RPM:     ");
-      break;
+uint8_t menu_scroll_offset = 0; // First text character displayed
+uint8_t menu_scroll_hold = MENU_SCROLL_HOLD; // Scroll steps left before moving
+/**
+ * Restarts the scrolling text from its first character
+ * Call this each time a text bound to a TEXT widget changes
+*/
+void menuTextChanged() {
+  menu_scroll_offset = 0;
+  menu_scroll_hold = MENU_SCROLL_HOLD;
+  menuInvalidate();
+}
+/**
+ * Scrolls the TEXT widgets of the current screen by one character if they are longer than their field
+ * Call this periodically, the widgets are redrawn by menuUpdateDynamic()
+ * @note The screens share one scroll position, so only one TEXT widget per screen should overflow
+*/
+void menuScroll() {
+  MenuScreen screen = menuScreen();
+  for (uint8_t i = 0; i < screen.count; i++) {
+    Widget widget;
+    memcpy_P(&widget, &screen.widgets[i], sizeof(widget));
+    if (widget.type != WIDGET_TEXT)
+      continue;
+
+    uint8_t length = strlen((const char*)widget.value);
+    if (length <= widget.width)
+      continue;
+
+    if (menu_scroll_hold) {
+      menu_scroll_hold--;
+      return;
+    }
+    menu_scroll_offset++;
+    if (menu_scroll_offset >= length + MENU_SCROLL_GAP) {
+      menu_scroll_offset = 0;
+      menu_scroll_hold = MENU_SCROLL_HOLD;
     }
+    return;
+  }
+}
+// Bar graph glyphs, in the glyph slots 0-4: 1 to 5 lit columns
+#define MENU_BAR_SLOT 0
+const uint8_t menu_bar_glyphs[5][8] PROGMEM = {
+  {0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00},
+  {0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00},
+  {0x00, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x00},
+  {0x00, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x00},
+  {0x00, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00},
+};
 
-    case Credit: {
-      strcat(l1, "G111   2022-2023");
-      strcat(l2, "Git: Angers-SAE2");
-      strcat(l3, " Arthur  DUPONT ");
-      strcat(l4, "  Mael   GADOU  ");
+/**
+ * Gives the number of lit pixel columns of a bar graph
+*/
+uint16_t menuBarColumns(const Widget* widget) {
+  uint16_t value = widget->arg == 1 ? *(const uint8_t*)widget->value : *(const uint16_t*)widget->value;
+  uint16_t columns = widget->width * 5;
+  if (value >= widget->max)
+    return columns;
+  return (uint32_t)value * columns / widget->max;
+}
+
+/**
+ * Gives the value a widget displays
+ * @returns The key of the widget, it changes when the widget must be redrawn
+*/
+uint32_t menuWidgetKey(const Widget* widget) {
+  uint32_t key = 0;
+  switch (widget->type) {
+    case WIDGET_U8:
+      key = *(const uint8_t*)widget->value;
+      break;
+    case WIDGET_U16:
+      key = *(const uint16_t*)widget->value;
+      break;
+    case WIDGET_TOGGLE:
+      key = (*(const uint8_t*)widget->value & widget->arg) != 0;
+      break;
+    case WIDGET_TEXT:
+      key = menu_scroll_offset;
+      break;
+    case WIDGET_BAR:
+      key = menuBarColumns(widget);
       break;
-    }
   }
-  lcdGoto(0, 0);
-  lcdPrint(l1);
-  lcdGoto(0, 1);
-  lcdPrint(l2);
-  lcdGoto(0, 2);
-  lcdPrint(l3);
-  lcdGoto(0, 3);
-  lcdPrint(l4);
+  if (widget->alt != NULL && *widget->alt)
+    key |= 1UL << 16;
+  return key;
 }
 /**
- * Updates the dynamic parts of the menu
- * Can be called as much as you want
- * @param dt The data mayload to send to the current menu
-*/
-void menuUpdateDynamic(uint8_t* dt) {
-  switch (*menu_pt) {
-    case Stereo: {
-      // Print the music title ========
-      lcdGoto(1, 7);
-      lcdPrint((char*)dt[0]);
-
-      // Print the volume =============
-      // Convert the volume to string
-      char volume_txt[5] = "000%%";
-      sprintf(volume_txt, "%3d%%", dt[1]);
-
-      // Display MUTE when muted
-      if (dt[2])
-        sprintf(volume_txt, "MUTE");
-      // Print
-      lcdGoto(2, 8);
-      lcdPrint(volume_txt);
-
-      // Print the source =============
-      lcdGoto(3, 8);
-      if (dt[3])
-        lcdPrint("[Jack]");
-      else
-        lcdPrint("[RCA ]");
-      
+ * Writes a widget in the framebuffer
+*/
+void menuDrawWidget(const Widget* widget) {
+  switch (widget->type) {
+    case WIDGET_LABEL: {
+      lcdFbPrint_P(widget->x, widget->y, widget->text);
       break;
     }
-    case Effects: {
-      // Bass FX
-      lcdGoto(0, 1);
-      if (dt[0] & 0x01)
-        lcdPrint(" [Bass]");
-      else
-        lcdPrint("  Bass ");
-      // Dist FX
-      if (dt[0] & 0x02)
-        lcdPrint(" [Dist]");
+
+    case WIDGET_U8:
+    case WIDGET_U16: {
+      if (widget->alt != NULL && *widget->alt) {
+        lcdFbPrint_P(widget->x, widget->y, widget->text);
+        break;
+      }
+
+      char txt[7];
+      uint16_t value = widget->type == WIDGET_U8 ? *(const uint8_t*)widget->value : *(const uint16_t*)widget->value;
+      char* end = fmtU16(txt, value, widget->width, ' ');
+      if (widget->arg) {
+        end[0] = widget->arg;
+        end[1] = '\0';
+      }
+      lcdFbPrint(widget->x, widget->y, txt);
+      break;
+    }
+
+    case WIDGET_TOGGLE: {
+      if (*(const uint8_t*)widget->value & widget->arg)
+        lcdFbPrint_P(widget->x, widget->y, widget->text);
       else
-        lcdPrint("  Dist ");
+        lcdFbPrint_P(widget->x, widget->y, widget->text_off);
+      break;
+    }
+
+    case WIDGET_TEXT: {
+      const char* text = widget->value;
+      uint8_t length = strlen(text);
+
+      // Placeholder, padded to the field width
+      if (length == 0) {
+        for (uint8_t i = 0; i < widget->width; i++)
+          lcdFbPutChar(widget->x + i, widget->y, ' ');
+        lcdFbPrint_P(widget->x, widget->y, widget->text);
+        break;
+      }
+
+      // Texts longer than the field loop around, separated by MENU_SCROLL_GAP blank cells
+      for (uint8_t i = 0; i < widget->width; i++) {
+        char c = ' ';
+        if (length <= widget->width) {
+          if (i < length) c = text[i];
+        } else {
+          uint8_t index = (menu_scroll_offset + i) % (length + MENU_SCROLL_GAP);
+          if (index < length) c = text[index];
+        }
+        lcdFbPutChar(widget->x + i, widget->y, c);
+      }
+      break;
     }
-    case Fan: {
-      // Convert the temp to text
-      char temp_txt[5] = "00C";
-      sprintf(temp_txt, "%2dC", dt[0]);
-      // Print the temp to the lcd
-      lcdGoto(3, 1);
-      lcdPrint(temp_txt);
-
-      // Convert the fan RPM to text
-      char fan_rpm_txt[5] = "0000";
-      if (dt[1] <= 0) dt[1] = 1;
-      sprintf(fan_rpm_txt, "%4d", (int)(1. / dt[1] * 60.));
-      // Print the RPM to the lcd
-      lcdGoto(16-4,1);
-      lcdPrint(fan_rpm_txt);
+
+    case WIDGET_BAR: {
+      // The glyphs are only sent once, see lcdFbGlyph()
+      for (uint8_t i = 0; i < 5; i++)
+        lcdFbGlyph(MENU_BAR_SLOT + i, menu_bar_glyphs[i]);
+
+      uint16_t columns = menuBarColumns(widget);
+      for (uint8_t i = 0; i < widget->width; i++) {
+        char c = ' ';
+        if (columns >= 5)
+          c = LCD_GLYPH(MENU_BAR_SLOT + 4);
+        else if (columns > 0)
+          c = LCD_GLYPH(MENU_BAR_SLOT + columns - 1);
+        columns = columns > 5 ? columns - 5 : 0;
+        lcdFbPutChar(widget->x + i, widget->y, c);
+      }
       break;
     }
   }
 }
+/**
+ * Prints the static parts of the current menu
+ * Call this each time you want to change menu
+ * @note Only writes the framebuffer, see lcdFlush()
+*/
+void menuUpdateStatic() {
+  PROF_BEGIN(PROF_MENU_STATIC);
+
+  lcdFbClear();
+  menuInvalidate();
+  menu_scroll_offset = 0;
+  menu_scroll_hold = MENU_SCROLL_HOLD;
+
+  // Print the labels, the other widgets are drawn by menuUpdateDynamic()
+  MenuScreen screen = menuScreen();
+  for (uint8_t i = 0; i < screen.count; i++) {
+    Widget widget;
+    memcpy_P(&widget, &screen.widgets[i], sizeof(widget));
+    if (widget.type == WIDGET_LABEL)
+      menuDrawWidget(&widget);
+  }
+
+  PROF_END(PROF_MENU_STATIC, 500);
+}
+/**
+ * Redraws the widgets of the current menu whose bound value changed
+ * Can be called as much as you want, only the changed widgets are written
+ * @note Only writes the framebuffer, see lcdFlush()
+*/
+void menuUpdateDynamic() {
+  PROF_BEGIN(PROF_MENU_DYNAMIC);
+
+  MenuScreen screen = menuScreen();
+  for (uint8_t i = 0; i < screen.count; i++) {
+    Widget widget;
+    memcpy_P(&widget, &screen.widgets[i], sizeof(widget));
+    if (widget.type == WIDGET_LABEL)
+      continue;
+
+    uint32_t key = menuWidgetKey(&widget);
+    if (key == menu_keys[i])
+      continue;
+    menu_keys[i] = key;
+    menuDrawWidget(&widget);
+  }
+
+  PROF_END(PROF_MENU_DYNAMIC, 500);
+}
 
-#endif
\ No newline at end of file
+#endif
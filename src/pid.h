@@ -0,0 +1,92 @@
+/*
+ * pid.h
+ *
+ * Created: 17/10/2026 00:27:44
+ * Author : agent
+ */
+
+#include <stdint.h>
+#include "fixed.h"
+
+#ifndef PID_H_
+#define PID_H_
+
+/**
+ * Integer PID controller state
+ * The gains are Q8.8 (output units per input unit, per sample for ki and kd)
+ * The controller MUST be updated at a fixed rate
+*/
+typedef struct {
+  q8_8_t kp, ki, kd;     // Gains
+  int16_t out_min;       // Minimum output
+  int16_t out_max;       // Maximum output
+  int32_t integral;      // Integral term, Q8.8 output units
+  int16_t last_measure;  // Measure of the previous update
+  uint8_t started;       // Set after the first update
+} Pid;
+
+/**
+ * Builds a PID controller
+ * @param kp_ The proportional gain, Q8.8
+ * @param ki_ The integral gain, Q8.8
+ * @param kd_ The derivative gain, Q8.8
+ * @param min The minimum output
+ * @param max The maximum output
+*/
+#define PID(kp_, ki_, kd_, min, max) { kp_, ki_, kd_, min, max, 0, 0, 0 }
+
+/**
+ * Resets the integral and derivative memory of the controller
+*/
+void pidReset(Pid* pid) {
+  pid->integral = 0;
+  pid->started = 0;
+}
+
+/**
+ * Runs one controller update
+ * - The derivative acts on the measure, so setpoint steps do not kick the output
+ * - The integral corrects the feedforward, so it is signed and clamped to
+ *   +-(out_max - out_min). It only grows until the output saturates in the
+ *   same direction (anti-windup)
+ * @param pid The controller
+ * @param setpoint The target value
+ * @param measure The measured value
+ * @param feedforward Output added before the feedback terms, in output units
+ * @return The output, clamped to [out_min, out_max]
+*/
+int16_t pidUpdate(Pid* pid, int16_t setpoint, int16_t measure, int16_t feedforward) {
+  int16_t error = satSub16(setpoint, measure);
+
+  if (!pid->started) {
+    pid->last_measure = measure;
+    pid->started = 1;
+  }
+
+  int32_t p = (int32_t)pid->kp * error;
+  int32_t d = -(int32_t)pid->kd * (int32_t)(measure - pid->last_measure);
+  pid->last_measure = measure;
+
+  // Integrate, relative to the feedforward
+  int32_t i = pid->integral + (int32_t)pid->ki * error;
+  int32_t i_limit = ((int32_t)pid->out_max - pid->out_min) << 8;
+  if (i < -i_limit) i = -i_limit;
+  if (i > i_limit) i = i_limit;
+
+  // Stop the integral where the output saturates, never push it further
+  int32_t base = ((int32_t)feedforward << 8) + p + d;
+  int32_t o_min = (int32_t)pid->out_min << 8;
+  int32_t o_max = (int32_t)pid->out_max << 8;
+  if (i > pid->integral && base + i > o_max)
+    i = o_max - base > pid->integral ? o_max - base : pid->integral;
+  if (i < pid->integral && base + i < o_min)
+    i = o_min - base < pid->integral ? o_min - base : pid->integral;
+  pid->integral = i;
+
+  int32_t out = (base + i + 0x80) >> 8;
+  if (out < pid->out_min) return pid->out_min;
+  if (out > pid->out_max) return pid->out_max;
+  return out;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * power.h
+ *
+ * Created: 17/10/2026 00:43:24
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include "tick.h"
+#include "scheduler.h"
+#include "adc.h"
+#include "usart.h"
+#ifdef LCD_USE_SOFTWARESERIAL
+#include "softwareserial.h"
+#endif
+
+#ifndef POWER_H_
+#define POWER_H_
+
+// Sleep of the main loop
+// - When no task is due, the CPU sleeps in Idle mode until the next interrupt
+//   (at the latest the next tick)
+// - Every POWER_QUIET_PERIOD ticks, ADC_QUIET_CHANNEL is converted in the ADC
+//   noise reduction mode, with the CPU and I/O clocks stopped. As this also
+//   stops the timers and the serial links for ~110us, it is only done when no
+//   serial link moved since the previous quiet conversion. After
+//   POWER_QUIET_TRIES busy attempts, the conversion is done in Idle mode instead.
+// - The time spent sleeping is measured with TIM1, see powerLoad()
+// @note TIM1 is stopped during the noise reduction conversions, the time base
+//   runs late by ~110us per conversion (0.7% at the default period)
+
+#ifndef POWER_QUIET_PERIOD
+#define POWER_QUIET_PERIOD 16
+#endif
+#ifndef POWER_QUIET_TRIES
+#define POWER_QUIET_TRIES 4
+#endif
+
+uint16_t power_quiet_next = 0;     // Tick of the next quiet conversion
+uint8_t power_quiet_skipped = 0;   // Busy attempts since the last conversion
+uint8_t power_rx_head = 0;         // USART RX head at the last attempt
+uint8_t power_tx_tail = 0;         // USART TX tail at the last attempt
+#ifdef LCD_USE_USART
+uint8_t power_lcd_tail = 0;        // USART LCD queue tail at the last attempt
+#endif
+uint32_t power_idle = 0;           // Time slept since the last powerLoad(), TIM1 counts
+uint16_t power_window = 0;         // Tick of the last powerLoad()
+
+/**
+ * Sleeps until an interrupt
+ * @param mode The sleep mode (SLEEP_MODE_IDLE or SLEEP_MODE_ADC)
+ * @note MUST be called with the interrupts disabled, returns with them enabled
+*/
+void powerSleep(uint8_t mode) {
+  set_sleep_mode(mode);
+  sleep_enable();
+  sei(); // The instruction after sei() always runs, no interrupt is missed
+  sleep_cpu();
+  sleep_disable();
+}
+
+/**
+ * Checks that no serial link moved since the last call
+ * @returns Boolean, if stopping the I/O clocks now should not break a byte
+*/
+uint8_t powerLinesQuiet() {
+  uint8_t rx = usart_rx.head;
+  uint8_t tx = usart_tx.tail;
+  uint8_t quiet = rx == power_rx_head && tx == power_tx_tail && tx == usart_tx.head;
+  power_rx_head = rx;
+  power_tx_tail = tx;
+
+  #ifdef LCD_USE_SOFTWARESERIAL
+  if (softwareSerialBusy())
+    quiet = 0;
+  #else
+  uint8_t lcd = usart_lcd.tail;
+  if (lcd != power_lcd_tail || !RING_EMPTY(usart_lcd) || usart_switching)
+    quiet = 0;
+  power_lcd_tail = lcd;
+  #endif
+  return quiet;
+}
+
+/**
+ * Converts ADC_QUIET_CHANNEL, in the ADC noise reduction mode if the links are quiet
+*/
+void powerQuietConvert() {
+  uint8_t quiet = powerLinesQuiet();
+  if (!quiet && ++power_quiet_skipped < POWER_QUIET_TRIES)
+    return;
+  power_quiet_skipped = 0;
+
+  // Wait for the scanner to stop
+  adcQuietRequest();
+  cli();
+  while (!adcQuietReady()) {
+    powerSleep(SLEEP_MODE_IDLE);
+    cli();
+  }
+
+  adcQuietStart(!quiet);
+  while (adcQuietBusy()) {
+    powerSleep(quiet ? SLEEP_MODE_ADC : SLEEP_MODE_IDLE);
+    cli();
+  }
+  sei();
+}
+
+/**
+ * Sleeps until a task is due
+ * Call this in the main loop, after schedRun()
+ * @param tasks The task table
+ * @param count The number of tasks in the table
+*/
+void powerIdle(Task* tasks, uint8_t count) {
+  uint16_t start = timeNow();
+
+  if ((int16_t)(tickNow() - power_quiet_next) >= 0) {
+    power_quiet_next = tickNow() + POWER_QUIET_PERIOD;
+    powerQuietConvert();
+  }
+
+  cli();
+  if (!schedPending(tasks, count))
+    powerSleep(SLEEP_MODE_IDLE);
+  sei();
+
+  power_idle += (uint16_t)(timeNow() - start);
+}
+
+/**
+ * Gives the CPU load since the last call
+ * @returns The time spent awake, in 1/1000 of the time
+ * @note The interrupts that run during a sleep count as idle time
+ * @note Call it at least every 65s, the tick wraps around
+*/
+uint16_t powerLoad() {
+  uint16_t now = tickNow();
+  uint32_t total = (uint32_t)(uint16_t)(now - power_window) * TICK_PERIOD;
+  uint32_t idle = power_idle;
+  power_idle = 0;
+  power_window = now;
+
+  if (total == 0 || idle >= total)
+    return 0;
+  return 1000 - idle * 1000 / total;
+}
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * profiler.h
+ *
+ * Created: 17/10/2026 00:32:20
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include "tick.h"
+#include "usart.h"
+#include "format.h"
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+// Per handler execution time statistics
+// Define PROFILE to enable, the PROF_ macros compile to nothing otherwise.
+// Times are taken from the TIM1 time base, and reported in CPU cycles.
+
+enum ProfList {
+  PROF_BUTTONS,
+  PROF_VOLUME,
+  PROF_FAN,
+  PROF_MENU_STATIC,
+  PROF_MENU_DYNAMIC,
+  PROF_OVERFLOW
+};
+// Section names, in flash
+const char prof_name_buttons[] PROGMEM = "handleButtons";
+const char prof_name_volume[] PROGMEM = "handleVolume";
+const char prof_name_fan[] PROGMEM = "handleFan";
+const char prof_name_menu_static[] PROGMEM = "menuUpdateStatic";
+const char prof_name_menu_dynamic[] PROGMEM = "menuUpdateDynamic";
+const char* const prof_names[PROF_OVERFLOW] PROGMEM = {
+  prof_name_buttons,
+  prof_name_volume,
+  prof_name_fan,
+  prof_name_menu_static,
+  prof_name_menu_dynamic,
+};
+
+/**
+ * Statistics of one profiled section
+*/
+typedef struct {
+  uint16_t start;    // TIM1 time of the running section
+  uint16_t min;      // Min time, TIM1 counts
+  uint16_t max;      // Max time, TIM1 counts
+  uint32_t sum;      // Total time of the counted runs, TIM1 counts
+  uint16_t count;    // Number of runs, saturated
+  uint16_t overruns; // Number of runs longer than the budget, saturated
+} ProfEntry;
+ProfEntry prof_table[PROF_OVERFLOW];
+
+#ifdef PROFILE
+/**
+ * Marks the start of a profiled section
+ * @param id The section (see ProfList)
+*/
+#define PROF_BEGIN(id) (prof_table[id].start = timeNow())
+/**
+ * Marks the end of a profiled section and records its time
+ * @param id The section (see ProfList)
+ * @param budget_us The allowed time, in us
+*/
+#define PROF_END(id, budget_us) profRecord(id, (uint16_t)(timeNow() - prof_table[id].start), (budget_us) * (TICK_TIMER_HZ / 1000000UL))
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id, budget_us)
+#endif
+
+/**
+ * Clears all the statistics
+*/
+void profReset() {
+  for (uint8_t i = 0; i < PROF_OVERFLOW; i++) {
+    prof_table[i].min = UINT16_MAX;
+    prof_table[i].max = 0;
+    prof_table[i].sum = 0;
+    prof_table[i].count = 0;
+    prof_table[i].overruns = 0;
+  }
+}
+
+/**
+ * Records one run of a section
+ * @param id The section (see ProfList)
+ * @param time The run time, in TIM1 counts
+ * @param budget The allowed time, in TIM1 counts
+*/
+void profRecord(uint8_t id, uint16_t time, uint16_t budget) {
+  ProfEntry* entry = &prof_table[id];
+  if (time < entry->min) entry->min = time;
+  if (time > entry->max) entry->max = time;
+  if (time > budget && entry->overruns != UINT16_MAX)
+    entry->overruns++;
+
+  // The mean stays that of the first UINT16_MAX runs
+  if (entry->count != UINT16_MAX) {
+    entry->sum += time;
+    entry->count++;
+  }
+}
+
+// Longest dump line: the name, 3 times of at most 65535 counts * 8 cycles, 2 counters
+#define PROF_LINE_MAX 64
+uint8_t prof_dump_next = PROF_OVERFLOW; // Next section to send, PROF_OVERFLOW when no dump runs
+
+/**
+ * Starts sending the statistics table on the USART, see profDumpStep()
+*/
+void profDump() {
+  prof_dump_next = 0;
+}
+
+/**
+ * Sends the next line of a started dump, one line per section:
+ *   prof <name> <min> <max> <mean> <count> <overruns>
+ * with the times in CPU cycles
+ * Call it periodically. It never blocks: a line is only sent once the TX buffer has room for all of it.
+*/
+void profDumpStep() {
+  if (prof_dump_next >= PROF_OVERFLOW)
+    return;
+
+  const uint8_t k = F_CPU / TICK_TIMER_HZ; // Cycles per TIM1 count
+  ProfEntry* entry = &prof_table[prof_dump_next];
+  uint32_t values[5] = {
+    entry->count ? (uint32_t)entry->min * k : 0,
+    (uint32_t)entry->max * k,
+    entry->count ? entry->sum / entry->count * k : 0,
+    entry->count,
+    entry->overruns
+  };
+
+  char line[PROF_LINE_MAX] = "prof ";
+  char* end = line + 5;
+  const char* name = (const char*)pgm_read_ptr(&prof_names[prof_dump_next]);
+  for (char c = pgm_read_byte(name); c != '\0'; c = pgm_read_byte(++name))
+    *end++ = c;
+  for (uint8_t j = 0; j < 5; j++) {
+    *end++ = ' ';
+    end = fmtU32(end, values[j], 0, ' ');
+  }
+  *end++ = '\n';
+
+  uint8_t length = end - line;
+  if (usartTxFree() < length)
+    return;
+  usartWrite(line, length);
+  prof_dump_next++;
+}
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * protocol.h
+ *
+ * Created: 17/10/2026 00:33:15
+ * Author : agent
+ */
+
+#include <stdint.h>
+#include "usart.h"
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+// Binary host protocol
+// Frame: SYNC | type | length | payload[length] | CRC-8
+// - The CRC-8 (poly 0x07, init 0x00) covers type, length and payload
+// - Frames are parsed byte by byte as they arrive, see protoFeed()
+// - A frame can only start between text lines, so text commands ("cTitle ...")
+//   keep working on the same link
+// - Answers use the type of the request with PROTO_REPLY set
+#define PROTO_SYNC 0xA5
+#define PROTO_REPLY 0x80
+#ifndef PROTO_MAX_PAYLOAD
+#define PROTO_MAX_PAYLOAD 64
+#endif
+
+enum ProtoType {
+  PROTO_TITLE = 0x01,   // [chars...] Set the music title
+  PROTO_VOLUME = 0x02,  // [volume %] Set the volume
+  PROTO_MUTE = 0x03,    // [bool] Set the mute state
+  PROTO_SOURCE = 0x04,  // [bool] Set the source, 0 = RCA, 1 = Jack
+  PROTO_EFFECTS = 0x05, // [bits] Set the effects, bit0 = Bass, bit1 = Dist
+  PROTO_TELEMETRY_RATE = 0x06, // [period] Set the telemetry period in 100ms, 0 = off
+  PROTO_TEMP_CAL = 0x07, // [offset (i16), gain (u16), coupling (i16)] Set the temperature calibration, see TempCal
+                         // [] Only query it. Reply: calibration, ADC0 and ADC1 sums (u16), temperature Q8.8 (i16)
+  PROTO_STATUS = 0x10,  // [] Query the state: volume, mute, source, effects, menu, temp, rpm (u16)
+  PROTO_GET_TITLE = 0x11, // [] Query the music title
+  PROTO_TELEMETRY = 0x20  // Sent periodically by the amp, see taskTelemetry()
+};
+
+enum ProtoResult {
+  PROTO_IDLE,  // The byte is not part of a frame
+  PROTO_BUSY,  // The byte was used, the frame is not complete
+  PROTO_FRAME, // A valid frame is waiting in proto_frame
+  PROTO_ERROR  // The frame had a bad CRC or length and was dropped
+};
+
+/**
+ * A received frame
+*/
+typedef struct {
+  uint8_t type;
+  uint8_t length;
+  uint8_t payload[PROTO_MAX_PAYLOAD];
+} ProtoFrame;
+ProtoFrame proto_frame;
+
+enum ProtoState { PROTO_WAIT_SYNC, PROTO_WAIT_TYPE, PROTO_WAIT_LENGTH, PROTO_WAIT_PAYLOAD, PROTO_WAIT_CRC };
+uint8_t proto_state = PROTO_WAIT_SYNC;
+uint8_t proto_index = 0;   // Received payload bytes
+uint8_t proto_crc = 0;     // Running CRC
+
+/**
+ * Updates a CRC-8 (poly 0x07) with one byte
+*/
+uint8_t crc8Update(uint8_t crc, uint8_t byte_) {
+  crc ^= byte_;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+  return crc;
+}
+
+/**
+ * Drops the frame being received
+*/
+void protoReset() {
+  proto_state = PROTO_WAIT_SYNC;
+}
+
+/**
+ * Feeds one received byte to the frame parser
+ * @param byte_ The received byte
+ * @param can_start Boolean, if a new frame may start here (no text line pending)
+ * @returns The parser state after the byte, see ProtoResult
+ * @note On PROTO_FRAME, proto_frame is valid until the next call
+*/
+uint8_t protoFeed(uint8_t byte_, uint8_t can_start) {
+  switch (proto_state) {
+    case PROTO_WAIT_SYNC: {
+      if (byte_ != PROTO_SYNC || !can_start)
+        return PROTO_IDLE;
+      proto_crc = 0;
+      proto_state = PROTO_WAIT_TYPE;
+      return PROTO_BUSY;
+    }
+    case PROTO_WAIT_TYPE: {
+      proto_frame.type = byte_;
+      proto_crc = crc8Update(proto_crc, byte_);
+      proto_state = PROTO_WAIT_LENGTH;
+      return PROTO_BUSY;
+    }
+    case PROTO_WAIT_LENGTH: {
+      if (byte_ > PROTO_MAX_PAYLOAD) {
+        proto_state = PROTO_WAIT_SYNC;
+        return PROTO_ERROR;
+      }
+      proto_frame.length = byte_;
+      proto_crc = crc8Update(proto_crc, byte_);
+      proto_index = 0;
+      proto_state = byte_ ? PROTO_WAIT_PAYLOAD : PROTO_WAIT_CRC;
+      return PROTO_BUSY;
+    }
+    case PROTO_WAIT_PAYLOAD: {
+      proto_frame.payload[proto_index++] = byte_;
+      proto_crc = crc8Update(proto_crc, byte_);
+      if (proto_index >= proto_frame.length)
+        proto_state = PROTO_WAIT_CRC;
+      return PROTO_BUSY;
+    }
+    case PROTO_WAIT_CRC: {
+      proto_state = PROTO_WAIT_SYNC;
+      return byte_ == proto_crc ? PROTO_FRAME : PROTO_ERROR;
+    }
+  }
+
+  proto_state = PROTO_WAIT_SYNC;
+  return PROTO_IDLE;
+}
+
+/**
+ * Sends a frame on the USART
+ * @param type The frame type
+ * @param payload The payload, can be NULL if length is 0
+ * @param length The payload length, max PROTO_MAX_PAYLOAD
+*/
+void protoSend(uint8_t type, const uint8_t* payload, uint8_t length) {
+  uint8_t header[3] = {PROTO_SYNC, type, length};
+  uint8_t crc = crc8Update(crc8Update(0, type), length);
+  for (uint8_t i = 0; i < length; i++)
+    crc = crc8Update(crc, payload[i]);
+
+  // Queued by blocks, the UDRE interrupt only starts once per block
+  usartWrite(header, sizeof(header));
+  usartWrite(payload, length);
+  usartPutChar(crc);
+}
+
+#endif
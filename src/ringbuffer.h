@@ -0,0 +1,106 @@
+/*
+ * ringbuffer.h
+ *
+ * Created: 17/10/2026 00:50:10
+ * Author : agent
+ */
+
+#include <stdint.h>
+
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+// Single producer / single consumer ring buffers
+// A ring passes entries from one producer to one consumer, usually an ISR and
+// the main loop. Only the producer writes the head and only the consumer writes
+// the tail. Both are 8 bit, so each side reads the other's index atomically and
+// no interrupt has to be disabled:
+// - The producer stores the entry before moving the head
+// - The consumer reads the entry before moving the tail
+// One entry stays unused to tell a full ring from an empty one.
+// The size is taken from the buffer with sizeof(), so every mask is a constant.
+
+/**
+ * Declares a ring
+ * @param name The ring variable
+ * @param type The entry type
+ * @param size The number of entries, MUST be a power of 2 (max 256)
+*/
+#define RING(name, type, size) \
+  _Static_assert((size) >= 2 && (size) <= 256 && ((size) & ((size) - 1)) == 0, #name " size must be a power of 2"); \
+  struct { \
+    volatile uint8_t head; \
+    volatile uint8_t tail; \
+    volatile type buf[size]; \
+  } name
+
+#define RING_SIZE(r) (sizeof((r).buf) / sizeof((r).buf[0]))
+#define RING_MASK(r) ((uint8_t)(RING_SIZE(r) - 1))
+#define RING_NEXT(r, i) ((uint8_t)((i) + 1) & RING_MASK(r))
+
+// State, usable from both sides
+#define RING_EMPTY(r) ((r).head == (r).tail)
+#define RING_FULL(r) (RING_NEXT(r, (r).head) == (r).tail)
+// Entries waiting
+#define RING_COUNT(r) ((uint8_t)((r).head - (r).tail) & RING_MASK(r))
+// Entries that can be added
+#define RING_FREE(r) (RING_MASK(r) - RING_COUNT(r))
+
+/**
+ * Adds an entry, producer side
+ * @note The ring MUST NOT be full, check RING_FULL() first
+*/
+#define RING_PUT(r, x) do { \
+    uint8_t ring_head_ = (r).head; \
+    (r).buf[ring_head_] = (x); \
+    (r).head = RING_NEXT(r, ring_head_); \
+  } while (0)
+
+/**
+ * Adds several entries and publishes them at once, producer side
+ * @param src The entries
+ * @param n The number of entries, at most RING_FREE()
+*/
+#define RING_WRITE(r, src, n) do { \
+    uint8_t ring_head_ = (r).head; \
+    for (uint8_t ring_i_ = 0; ring_i_ < (n); ring_i_++) { \
+      (r).buf[ring_head_] = (src)[ring_i_]; \
+      ring_head_ = RING_NEXT(r, ring_head_); \
+    } \
+    (r).head = ring_head_; \
+  } while (0)
+
+// Consumer side. The ring MUST NOT be empty, or hold at least i+1 / n entries
+// Oldest entry, left in the ring
+#define RING_PEEK(r) ((r).buf[(r).tail])
+// Entry i after the oldest one, left in the ring
+#define RING_PEEK_AT(r, i) ((r).buf[(uint8_t)((r).tail + (i)) & RING_MASK(r)])
+// Releases the n oldest entries
+#define RING_DROP(r, n) ((r).tail = (uint8_t)((r).tail + (n)) & RING_MASK(r))
+
+/**
+ * Removes the oldest entry, consumer side
+ * @param x Set to the entry
+ * @note The ring MUST NOT be empty
+*/
+#define RING_GET(r, x) do { \
+    uint8_t ring_tail_ = (r).tail; \
+    (x) = (r).buf[ring_tail_]; \
+    (r).tail = RING_NEXT(r, ring_tail_); \
+  } while (0)
+
+/**
+ * Removes several entries, consumer side
+ * @param dst Filled with the entries
+ * @param n The number of entries, at most RING_COUNT()
+*/
+#define RING_READ(r, dst, n) do { \
+    uint8_t ring_tail_ = (r).tail; \
+    for (uint8_t ring_i_ = 0; ring_i_ < (n); ring_i_++) { \
+      (dst)[ring_i_] = (r).buf[ring_tail_]; \
+      ring_tail_ = RING_NEXT(r, ring_tail_); \
+    } \
+    (r).tail = ring_tail_; \
+  } while (0)
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * scheduler.h
+ *
+ * Created: 17/10/2026 00:26:35
+ * Author : agent
+ */
+
+#include <stdint.h>
+#include "tick.h"
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+/**
+ * A periodic task of the cooperative scheduler
+*/
+typedef struct {
+  void (*run)(void); // The handler, must return quickly
+  uint16_t period;   // Run period in ticks
+  uint16_t budget;   // Allowed run time in TIM1 counts (us)
+  uint16_t next;     // Tick of the next run
+  uint16_t overruns; // Number of runs longer than the budget
+} Task;
+
+/**
+ * Builds a task table entry
+ * @param fn The handler
+ * @param hz The run frequency, MUST divide TICK_HZ
+ * @param budget_us The allowed run time in us
+*/
+#define TASK(fn, hz, budget_us) { fn, TICK_HZ / (hz), budget_us, 0, 0 }
+
+uint16_t sched_loop_max = 0; // Longest schedRun() call, in TIM1 counts (us)
+uint16_t sched_overruns = 0; // Total task overruns
+
+/**
+ * Runs the tasks that are due, in table order
+ * Call it in the main loop, the first entries have the highest priority
+ * @param tasks The task table
+ * @param count The number of tasks in the table
+ * @note A late task runs once and is rescheduled one period from now, missed runs are not replayed
+*/
+void schedRun(Task* tasks, uint8_t count) {
+  uint16_t loop_start = timeNow();
+
+  for (uint8_t i = 0; i < count; i++) {
+    Task* task = &tasks[i];
+    uint16_t now = tickNow();
+    if ((int16_t)(now - task->next) < 0)
+      continue;
+
+    // Keep the period steady, unless we are more than one period late
+    task->next += task->period;
+    if ((int16_t)(now - task->next) >= 0)
+      task->next = now + task->period;
+
+    uint16_t start = timeNow();
+    task->run();
+    if ((uint16_t)(timeNow() - start) > task->budget) {
+      task->overruns++;
+      sched_overruns++;
+    }
+  }
+
+  uint16_t loop_time = timeNow() - loop_start;
+  if (loop_time > sched_loop_max)
+    sched_loop_max = loop_time;
+}
+
+/**
+ * Checks if a task is due
+ * @param tasks The task table
+ * @param count The number of tasks in the table
+ * @returns Boolean, if schedRun() would run a task now
+*/
+uint8_t schedPending(Task* tasks, uint8_t count) {
+  uint16_t now = tickNow();
+  for (uint8_t i = 0; i < count; i++) {
+    if ((int16_t)(now - tasks[i].next) >= 0)
+      return 1;
+  }
+  return 0;
+}
+
+#endif
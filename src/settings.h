@@ -0,0 +1,176 @@
+/*
+ * settings.h
+ *
+ * Created: 17/10/2026 00:40:49
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include <string.h>
+#include "eeprom.h"
+#include "protocol.h"
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+// Settings saved in EEPROM
+// The settings are a table of state variables (see SETTING()) saved together
+// as one record: version | sequence (u16) | data | CRC-8
+// - Each save goes to the next slot of a ring of SETTINGS_SLOTS, spreading the
+//   wear over the whole ring
+// - At startup the valid record (CRC and version) with the highest sequence is
+//   loaded. A save cut by a power loss fails its CRC and the previous one is used
+// - A change is only saved once the values stayed the same for SETTINGS_DELAY
+//   calls of settingsUpdate(), so holding a button does not write every step
+// - The bytes are programmed by the EE_RDY interrupt, see eeprom.h
+
+// Change it when the settings table changes, the old records are then ignored
+#ifndef SETTINGS_VERSION
+#define SETTINGS_VERSION 1
+#endif
+#ifndef SETTINGS_EEPROM_START
+#define SETTINGS_EEPROM_START 0
+#endif
+#ifndef SETTINGS_SLOTS
+#define SETTINGS_SLOTS 32
+#endif
+#define SETTINGS_SLOT_SIZE EEPROM_BUFFER_SIZE
+#define SETTINGS_DATA_MAX (SETTINGS_SLOT_SIZE - 4) // Record minus version, sequence and CRC
+// settingsUpdate() calls without change before saving
+#ifndef SETTINGS_DELAY
+#define SETTINGS_DELAY 30
+#endif
+
+/**
+ * A saved state variable
+*/
+typedef struct {
+  void* value;
+  uint8_t size;
+} Setting;
+#define SETTING(var) { &(var), sizeof(var) }
+
+const Setting* settings_table; // Table in flash
+uint8_t settings_count;
+uint8_t settings_length;                    // Size of the data, in bytes
+uint8_t settings_slot = SETTINGS_SLOTS - 1; // Slot of the newest record
+uint16_t settings_sequence = 0;             // Sequence of the newest record
+uint8_t settings_saved[SETTINGS_DATA_MAX];  // Data of the newest record
+uint8_t settings_last[SETTINGS_DATA_MAX];   // Data at the last settingsUpdate()
+uint8_t settings_stable = 0;                // Calls since the data last changed
+
+/**
+ * Copies the variables to a data block, or the data block to the variables
+ * @param data The data block
+ * @param store Boolean, if the variables are written from the block
+*/
+void settingsCopy(uint8_t* data, uint8_t store) {
+  for (uint8_t i = 0; i < settings_count; i++) {
+    Setting setting;
+    memcpy_P(&setting, &settings_table[i], sizeof(setting));
+    if (store)
+      memcpy(setting.value, data, setting.size);
+    else
+      memcpy(data, setting.value, setting.size);
+    data += setting.size;
+  }
+}
+
+/**
+ * Computes the CRC-8 of a record, without its CRC byte
+*/
+uint8_t settingsCrc(const uint8_t* record, uint8_t length) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++)
+    crc = crc8Update(crc, record[i]);
+  return crc;
+}
+
+/**
+ * Sets the settings table and loads the newest saved record
+ * The variables keep their current value when nothing valid is saved
+ * @param table The settings, in flash. Their total size MUST fit in SETTINGS_DATA_MAX
+ * @param count The number of settings
+ * @returns Boolean, if a record was loaded
+ * @note A table too large for a record is rejected, nothing is loaded nor saved
+*/
+uint8_t settingsInit(const Setting* table, uint8_t count) {
+  settings_table = table;
+  settings_count = count;
+  uint16_t length = 0;
+  for (uint8_t i = 0; i < count; i++)
+    length += pgm_read_byte(&table[i].size);
+  if (length > SETTINGS_DATA_MAX) {
+    settings_count = 0;
+    settings_length = 0;
+    return 0;
+  }
+  settings_length = length;
+
+  // Find the newest valid record
+  uint8_t record[SETTINGS_SLOT_SIZE];
+  uint8_t found = 0;
+  for (uint8_t slot = 0; slot < SETTINGS_SLOTS; slot++) {
+    eepromRead(SETTINGS_EEPROM_START + slot * SETTINGS_SLOT_SIZE, record, settings_length + 4);
+    if (record[0] != SETTINGS_VERSION || settingsCrc(record, settings_length + 3) != record[settings_length + 3])
+      continue;
+
+    uint16_t sequence = record[1] | record[2] << 8;
+    if (found && (int16_t)(sequence - settings_sequence) <= 0)
+      continue;
+    found = 1;
+    settings_slot = slot;
+    settings_sequence = sequence;
+    memcpy(settings_saved, record + 3, settings_length);
+  }
+
+  if (found)
+    settingsCopy(settings_saved, 1);
+  else
+    settingsCopy(settings_saved, 0); // Nothing to save until the defaults change
+  memcpy(settings_last, settings_saved, settings_length);
+  return found;
+}
+
+/**
+ * Starts writing the data block as a new record, in the next slot
+*/
+void settingsSave(const uint8_t* data) {
+  settings_slot = (settings_slot + 1) % SETTINGS_SLOTS;
+  settings_sequence++;
+
+  uint8_t record[SETTINGS_SLOT_SIZE];
+  record[0] = SETTINGS_VERSION;
+  record[1] = settings_sequence & 0xFF;
+  record[2] = settings_sequence >> 8;
+  memcpy(record + 3, data, settings_length);
+  record[settings_length + 3] = settingsCrc(record, settings_length + 3);
+
+  eepromWrite(SETTINGS_EEPROM_START + settings_slot * SETTINGS_SLOT_SIZE, record, settings_length + 4);
+  memcpy(settings_saved, data, settings_length);
+}
+
+/**
+ * Saves the settings once they stopped changing
+ * Call this periodically, it never waits for the EEPROM
+*/
+void settingsUpdate() {
+  uint8_t data[SETTINGS_DATA_MAX];
+  settingsCopy(data, 0);
+
+  if (memcmp(data, settings_last, settings_length) != 0) {
+    memcpy(settings_last, data, settings_length);
+    settings_stable = 0;
+    return;
+  }
+  if (settings_stable < SETTINGS_DELAY) {
+    settings_stable++;
+    return;
+  }
+
+  if (memcmp(data, settings_saved, settings_length) != 0 && !eepromBusy())
+    settingsSave(data);
+}
+
+#endif
@@ -5,9 +5,10 @@
  *  Author: Arthur DUPONT
  */ 
 
+#include "hal.h"
 #include <stdlib.h>
 #include <stdint.h>
-#include <util/delay.h>
+#include "ringbuffer.h"
 
 #ifndef SOFTWARESERIAL_H_
 #define SOFTWARESERIAL_H_
@@ -18,6 +19,24 @@ uint8_t software_serial_tx = 0, software_serial_rx = 0;
 #define SOFTWARESERIAL_BAUD 9600
 #endif
 
+// Size of the TX queue, MUST be a power of 2 (max 256)
+#ifndef SOFTWARESERIAL_TX_BUFFER_SIZE
+#define SOFTWARESERIAL_TX_BUFFER_SIZE 64
+#endif
+// TIM2 compare value for one bit time with the /8 prescaler
+#define SOFTWARESERIAL_OCR ((F_CPU / 8UL + SOFTWARESERIAL_BAUD / 2) / SOFTWARESERIAL_BAUD - 1)
+// Queue entries with this flag hold the line idle for (entry & ~flag) bit times instead of sending a byte
+#define SOFTWARESERIAL_IDLE_FLAG 0x8000
+#define SOFTWARESERIAL_IDLE_MAX 0x7FFF
+
+// TX queue, filled by the main loop and emptied by the TIM2 interrupt
+RING(software_serial_queue, uint16_t, SOFTWARESERIAL_TX_BUFFER_SIZE);
+
+// Frame currently being shifted out by the ISR
+volatile uint16_t software_serial_frame = 0; // Remaining bits, LSB first
+volatile uint16_t software_serial_bits = 0;  // Remaining bit times of the current entry
+volatile uint8_t software_serial_idle = 0;   // The current entry is an idle time
+
 /**
  * Configures the DDR register to use with the software serial
  * @param The A pointer to the DDR register
@@ -29,6 +48,7 @@ void softwareSerialInitReg(volatile uint8_t* reg) {
 /**
  * Configures the TX pin of the software serial
  * @param tx The TX pin to use within the selected port
+ * @note Uses TIM2 to clock the bits out
 */
 void softwareSerialInitTx(uint8_t tx) {
 	software_serial_tx = tx;
@@ -36,6 +56,10 @@ void softwareSerialInitTx(uint8_t tx) {
 	// Configure the TX pin
 	software_serial_reg[0] |= (1<<tx); // Output
 	software_serial_reg[1] |= (1<<tx); // Default level high
+
+	// Set TIM2 in CTC mode with a /8 prescaler, one compare match per bit
+	OCR2 = SOFTWARESERIAL_OCR;
+	TCCR2 = (1 << WGM21) | (1 << CS21);
 }
 /**
  * Configures the RX pin of the software serial
@@ -66,30 +90,102 @@ void softwareSerialInit(volatile uint8_t* reg, uint8_t* tx, uint8_t* rx) {
 		softwareSerialInitRx(*rx);
 }
 /**
- * Sends a byte synchronously on the asynchronous software serial bus.
+ * Clocks one bit out of the TX queue on each TIM2 compare match
+ * @note Disables itself once the queue is empty
+*/
+ISR(TIMER2_COMP_vect) {
+	// Load the next queue entry
+	if (software_serial_bits == 0) {
+		if (RING_EMPTY(software_serial_queue)) {
+			TIMSK &= ~(1 << OCIE2);
+			return;
+		}
+
+		uint16_t entry;
+		RING_GET(software_serial_queue, entry);
+
+		software_serial_idle = (entry & SOFTWARESERIAL_IDLE_FLAG) != 0;
+		if (software_serial_idle) {
+			software_serial_bits = entry & ~SOFTWARESERIAL_IDLE_FLAG;
+		} else {
+			// Start bit (low), 8 data bits, stop bit (high)
+			software_serial_frame = ((entry & 0xFF) << 1) | (1 << 9);
+			software_serial_bits = 10;
+		}
+	}
+
+	if (!software_serial_idle) {
+		if (software_serial_frame & 0x01)
+			software_serial_reg[1] |= (1<<software_serial_tx);
+		else
+			software_serial_reg[1] &= ~(1<<software_serial_tx);
+		software_serial_frame >>= 1;
+	}
+	software_serial_bits--;
+}
+
+/**
+ * Adds an entry to the TX queue and starts the transmission if needed
+ * @note Blocks while the queue is full, global interrupts must be enabled
+*/
+void softwareSerialQueue(uint16_t entry) {
+	while (RING_FULL(software_serial_queue))
+		halIdle();
+
+	RING_PUT(software_serial_queue, entry);
+
+	// Restart the bit clock if the line was idle
+	if (!(TIMSK & (1 << OCIE2))) {
+		TCNT2 = 0;
+		TIFR = (1 << OCF2);
+		TIMSK |= (1 << OCIE2);
+	}
+}
+
+/**
+ * Queues a byte on the asynchronous software serial bus.
  * @note 1Start bit, 8Data bits, 1Stop bit
+ * @note Only blocks if the TX queue is full
 */
 void softwareSerialSend(char byte) {
-	float d_us = 1./(float)SOFTWARESERIAL_BAUD*1000000.;
-	float d_cpu_us = 1./(float)F_CPU*1000000.;
-
-    // Start bit (pull down)
-	software_serial_reg[1] &= ~(1<<software_serial_tx);
-    _delay_us(d_us-d_cpu_us*20.);
-
-    // Data bits
-    for (uint8_t i = 0; i < 8; i++) {
-        if (byte & (1<<i))
-            software_serial_reg[1] |= (1<<software_serial_tx);
-        else
-            software_serial_reg[1] &= ~(1<<software_serial_tx);
-
-        _delay_us(d_us-d_cpu_us*60.);
-    }
-
-    // Stop bit (pull up)
-    software_serial_reg[1] |= (1<<software_serial_tx);
-    _delay_us(d_us-d_cpu_us*20.);
+	softwareSerialQueue((uint8_t)byte);
+}
+
+/**
+ * Queues an idle time on the bus, the next bytes will be sent after it
+ * Use it to give the receiver time to process a command without blocking the CPU
+ * @param bits The idle time in bit times (1/SOFTWARESERIAL_BAUD s)
+*/
+void softwareSerialIdle(uint16_t bits) {
+	if (bits == 0)
+		return;
+	if (bits > SOFTWARESERIAL_IDLE_MAX)
+		bits = SOFTWARESERIAL_IDLE_MAX;
+	softwareSerialQueue(SOFTWARESERIAL_IDLE_FLAG | bits);
+}
+
+/**
+ * Get the free space in the TX queue
+ * @returns The number of entries that can be queued without waiting
+*/
+uint8_t softwareSerialFree() {
+	return RING_FREE(software_serial_queue);
+}
+
+/**
+ * Checks if the software serial is still sending
+ * @returns Boolean, if the TX queue or the current frame is not finished
+*/
+uint8_t softwareSerialBusy() {
+	return (TIMSK & (1 << OCIE2)) != 0;
+}
+
+/**
+ * Waits for all the queued data to be sent
+*/
+void softwareSerialFlush() {
+	while (softwareSerialBusy())
+		halIdle();
 }
 
 #endif
\ No newline at end of file
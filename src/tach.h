@@ -0,0 +1,125 @@
+/*
+ * tach.h
+ *
+ * Created: 17/10/2026 00:27:08
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+
+#ifndef TACH_H_
+#define TACH_H_
+
+// The tach input (PB0) has no capture unit nor external interrupt, and its T0
+// counter input belongs to TIM0 which generates the fan PWM. The tach is
+// instead sampled on each TIM0 overflow (Fast PWM, /8 prescaler), which gives
+// a hardware timed sampling period of 256us, independent of the main loop.
+#define TACH_SAMPLE_HZ (F_CPU / 8UL / 256UL)
+
+// Number of tach pulses per fan revolution
+#ifndef TACH_PULSES_PER_REV
+#define TACH_PULSES_PER_REV 1
+#endif
+// Number of periods averaged for the speed, MUST be a power of 2
+#ifndef TACH_AVERAGE
+#define TACH_AVERAGE 8
+#endif
+// Time without a pulse before the fan is considered stopped, in ms
+#ifndef TACH_STALL_MS
+#define TACH_STALL_MS 500
+#endif
+#define TACH_STALL_SAMPLES ((uint32_t)TACH_STALL_MS * TACH_SAMPLE_HZ / 1000)
+// rpm = TACH_RPM_K * periods / samples
+#define TACH_RPM_K (60UL * TACH_SAMPLE_HZ / TACH_PULSES_PER_REV)
+// Fastest speed measured, shorter periods are noise on the tach line
+#ifndef TACH_RPM_LIMIT
+#define TACH_RPM_LIMIT (2UL * FAN_RPM_MAX)
+#endif
+#define TACH_MIN_SAMPLES (TACH_RPM_K / TACH_RPM_LIMIT)
+
+// Sampling state, only used by the ISR
+uint8_t tach_last = 0;                  // Last tach level
+uint16_t tach_elapsed = 0;              // Samples since the last rising edge
+uint16_t tach_periods[TACH_AVERAGE];    // Last periods, in samples
+uint8_t tach_index = 0;                 // Next slot in tach_periods
+uint16_t tach_window = 0;               // Sum of the valid tach_periods
+uint8_t tach_valid = 0;                 // Number of valid tach_periods
+// Published measure
+volatile uint16_t tach_sum = 0;         // Sum of the last tach_count periods, in samples
+volatile uint8_t tach_count = 0;        // Number of periods in tach_sum, 0 if stalled
+volatile uint8_t tach_new = 0;          // Set when tach_sum changed
+uint16_t tach_rpm = 0;                  // Cached speed
+
+/**
+ * Starts the tach sampling
+ * @note TIM0 must be running, see initGpio()
+*/
+void tachInit() {
+  TIMSK |= (1 << TOIE0);
+}
+
+/**
+ * Samples the tach input and measures the period between rising edges
+*/
+ISR(TIMER0_OVF_vect) {
+  uint8_t level = PINB & (1 << PB0);
+
+  if (tach_elapsed < UINT16_MAX)
+    tach_elapsed++;
+
+  // Rising edge, a glitch too close to the last edge is ignored
+  if (level && !tach_last && tach_elapsed >= TACH_MIN_SAMPLES) {
+    if (tach_elapsed < TACH_STALL_SAMPLES) {
+      // Replace the oldest period of the window
+      if (tach_valid == TACH_AVERAGE)
+        tach_window -= tach_periods[tach_index];
+      else
+        tach_valid++;
+      tach_periods[tach_index] = tach_elapsed;
+      tach_window += tach_elapsed;
+      tach_index = (tach_index + 1) & (TACH_AVERAGE - 1);
+
+      tach_sum = tach_window;
+      tach_count = tach_valid;
+      tach_new = 1;
+    }
+    tach_elapsed = 0;
+  }
+  tach_last = level;
+
+  // Stall, restart the averaging
+  if (tach_elapsed == TACH_STALL_SAMPLES) {
+    tach_window = 0;
+    tach_valid = 0;
+    tach_count = 0;
+    tach_new = 1;
+  }
+}
+
+/**
+ * Get the fan speed
+ * @return The speed in rpm averaged over the last TACH_AVERAGE pulses, 0 if the fan is stopped, saturated to UINT16_MAX
+ * @note Only divides when a new pulse was measured since the last call
+*/
+uint16_t tachGetRpm() {
+  uint16_t sum;
+  uint8_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (!tach_new)
+      return tach_rpm;
+    tach_new = 0;
+    sum = tach_sum;
+    count = tach_count;
+  }
+
+  if (count == 0 || sum == 0) {
+    tach_rpm = 0;
+  } else {
+    uint32_t rpm = (TACH_RPM_K * count) / sum;
+    tach_rpm = rpm > UINT16_MAX ? UINT16_MAX : rpm;
+  }
+  return tach_rpm;
+}
+
+#endif
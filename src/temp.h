@@ -0,0 +1,109 @@
+/*
+ * temp.h
+ *
+ * Created: 17/10/2026 00:45:09
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+#include "fixed.h"
+#include "adc.h"
+
+#ifndef TEMP_H_
+#define TEMP_H_
+
+// LM335 temperature pipeline, run by tempUpdate() at a fixed rate:
+// 1. The sum of 2^ADC_OVERSAMPLE_LOG2 conversions of ADC_QUIET_CHANNEL, taken
+//    after the MUX settled and in the ADC noise reduction mode (see adc.h and
+//    power.h), scaled to 16 samples (0-16368)
+// 2. The volume knob on ADC0 couples into the reading through the PCB:
+//    coupling * the ADC0 sum is subtracted
+// 3. Per board calibration: temp = offset + gain * sum
+// 4. First order IIR low pass filter
+// The result is in Q8.8 degrees C.
+
+#define TEMP_VOLUME_CHANNEL 0
+// Scales an ADC sum to 16 samples
+#if ADC_OVERSAMPLE_LOG2 >= 4
+#define TEMP_SUM16(sum) ((sum) >> (ADC_OVERSAMPLE_LOG2 - 4))
+#else
+#define TEMP_SUM16(sum) ((sum) << (4 - ADC_OVERSAMPLE_LOG2))
+#endif
+
+// Default calibration, the nominal 50C full scale of the board
+#ifndef TEMP_CAL_OFFSET
+#define TEMP_CAL_OFFSET Q8_8(0)
+#endif
+#ifndef TEMP_CAL_GAIN
+#define TEMP_CAL_GAIN ((uint16_t)(65536. * 256. * 50. / (1023. * 16.) + 0.5))
+#endif
+#ifndef TEMP_CAL_COUPLING
+#define TEMP_CAL_COUPLING 0
+#endif
+// IIR filter strength, the time constant is ~2^TEMP_IIR_SHIFT updates
+#ifndef TEMP_IIR_SHIFT
+#define TEMP_IIR_SHIFT 2
+#endif
+
+/**
+ * Per board calibration, saved with the settings
+*/
+typedef struct {
+  q8_8_t offset;    // Temperature at a 0 reading, Q8.8 C
+  uint16_t gain;    // Q8.8 C per unit of the 16 samples sum, in 1/65536
+  int16_t coupling; // ADC0 to ADC1 coupling, Q1.15 (ADC1 counts per ADC0 count)
+} TempCal;
+TempCal temp_cal = {TEMP_CAL_OFFSET, TEMP_CAL_GAIN, TEMP_CAL_COUPLING};
+
+int32_t temp_filter = 0;   // IIR state, Q8.8 << TEMP_IIR_SHIFT
+uint8_t temp_started = 0;  // Set once the filter is loaded
+
+/**
+ * Restarts the filter from the next reading
+ * Call this after changing temp_cal
+*/
+void tempCalChanged() {
+  temp_started = 0;
+}
+
+/**
+ * Gives the sum of the temperature channel, minus the volume knob coupling
+ * @returns The corrected sum, scaled to 16 samples
+*/
+int32_t tempCorrectedSum() {
+  int32_t sum = TEMP_SUM16((int32_t)adcGetSum(ADC_QUIET_CHANNEL));
+  int32_t volume = TEMP_SUM16((int32_t)adcGetSum(TEMP_VOLUME_CHANNEL));
+  return sum - (((int32_t)temp_cal.coupling * volume) >> 15);
+}
+
+/**
+ * Gives the last filtered temperature
+ * @returns The temperature of the last tempUpdate(), Q8.8 C
+*/
+q8_8_t tempGet() {
+  return temp_filter >> TEMP_IIR_SHIFT;
+}
+
+/**
+ * Runs the pipeline on the latest reading
+ * @returns The filtered temperature, Q8.8 C
+ * @note Must be called at a fixed rate, the filter time constant depends on it
+*/
+q8_8_t tempUpdate() {
+  // The LM335 never outputs 0V, a 0 sum means no reading yet
+  if (adcGetSum(ADC_QUIET_CHANNEL) == 0)
+    return tempGet();
+
+  int32_t temp = temp_cal.offset + ((tempCorrectedSum() * temp_cal.gain) >> 16);
+  temp = sat16(temp);
+
+  if (!temp_started) {
+    temp_filter = temp << TEMP_IIR_SHIFT;
+    temp_started = 1;
+  }
+  temp_filter += temp - (temp_filter >> TEMP_IIR_SHIFT);
+  return tempGet();
+}
+
+#endif
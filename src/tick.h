@@ -0,0 +1,78 @@
+/*
+ * tick.h
+ *
+ * Created: 17/10/2026 00:26:35
+ * Author : agent
+ */
+
+#include "hal.h"
+#include <stdint.h>
+
+#ifndef TICK_H_
+#define TICK_H_
+
+// TIM1 runs freely at F_CPU/8 and is the time base of the firmware:
+// - TCNT1 gives the time in us (wraps every 65.5ms)
+// - The OCR1A compare match generates the system tick
+#define TICK_TIMER_HZ (F_CPU / 8UL)
+#ifndef TICK_HZ
+#define TICK_HZ 1000
+#endif
+#define TICK_PERIOD (TICK_TIMER_HZ / TICK_HZ) // Timer counts per tick
+#define TICK_TIME_WRAP (65536UL * TICK_HZ / TICK_TIMER_HZ) // Ticks before the TIM1 time wraps around
+
+volatile uint16_t tick_count = 0; // Ticks since the start, wraps around
+
+/**
+ * Called on each tick from the interrupt, MUST be defined by the application
+ * @note Keep it short, it runs with the interrupts disabled
+*/
+void tickHook();
+
+/**
+ * Starts the system tick
+ * @note Global interrupts must be enabled for the tick to run
+*/
+void tickInit() {
+  // Set TIM1 in Normal mode with a /8 prescaler
+  TCCR1A = 0;
+  TCCR1B = (1 << CS11);
+  OCR1A = TICK_PERIOD;
+  TIFR = (1 << OCF1A);
+  TIMSK |= (1 << OCIE1A);
+}
+
+/**
+ * Counts the ticks and schedules the next one
+*/
+ISR(TIMER1_COMPA_vect) {
+  OCR1A += TICK_PERIOD;
+  tick_count++;
+  tickHook();
+}
+
+/**
+ * Get the number of ticks since the start
+ * @note Wraps around, compare ticks with a difference: (int16_t)(a - b) < 0
+*/
+uint16_t tickNow() {
+  uint16_t t;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    t = tick_count;
+  }
+  return t;
+}
+
+/**
+ * Get the free running TIM1 time
+ * @return The time in TIM1 counts (us at 8MHz), wraps every 65536 counts
+*/
+uint16_t timeNow() {
+  uint16_t t;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    t = TCNT1;
+  }
+  return t;
+}
+
+#endif
@@ -7,38 +7,362 @@
 #ifndef USB_H_
 #define USB_H_
 
+#ifdef LCD_USE_USART
+#ifndef USART_LCD_BAUDRATE
+#define USART_LCD_BAUDRATE 19200
+#endif
+// Same rate as the LCD by default, so the line never changes its baud rate
+#ifndef BAUDRATE
+#define BAUDRATE USART_LCD_BAUDRATE
+#endif
+#endif
+#ifndef BAUDRATE
 #define BAUDRATE 9600
+#endif
 
-#include <avr/io.h>
+#include "hal.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include "ringbuffer.h"
+#ifdef LCD_USE_USART
+#include "tick.h"
+#endif
+
+// Size of the RX ring buffer, MUST be a power of 2 (max 256)
+#ifndef USART_RX_BUFFER_SIZE
+#define USART_RX_BUFFER_SIZE 64
+#endif
+// Size of the TX ring buffer, MUST be a power of 2 (max 256)
+#ifndef USART_TX_BUFFER_SIZE
+#define USART_TX_BUFFER_SIZE 64
+#endif
+
+// Max length of a received line (without the '\n')
+#ifndef MAX_USART_RX
+#define MAX_USART_RX 100
+#endif
+
+// RX ring buffer, filled by the RXC interrupt and emptied by the main loop
+RING(usart_rx, char, USART_RX_BUFFER_SIZE);
+volatile uint8_t usart_rx_overflow = 0; // Set when a byte was dropped because the buffer was full
+
+// TX ring buffer, filled by the main loop and emptied by the UDRE interrupt
+RING(usart_tx, char, USART_TX_BUFFER_SIZE);
+
+#ifdef LCD_USE_USART
+// Port sharing with the LCD
+// The LCD listens on the TXD line too, at its own baud rate. The TX side is
+// multiplexed between two queues, the host one (usart_tx) and the LCD one:
+// - The UDRE interrupt sends the bytes of the side the line is set for (owner)
+// - When the other side has bytes ready and the owner has none, or the owner
+//   already sent USART_BURST bytes, the interrupt stops and waits for the last
+//   byte to leave (TXC). The TXC interrupt then switches the baud rate (if they
+//   differ) and the TXD select pin, and restarts the transmission.
+// - The LCD queue also holds waits, given to the LCD to process a command. While
+//   the LCD waits, the line goes to the host. The tick ends the wait, see usartTick().
+// @note With a host BAUDRATE other than USART_LCD_BAUDRATE, the bytes received
+//   while the line is at the LCD rate are lost (the protocol CRC rejects the
+//   broken frames)
+
+// Size of the LCD queue, MUST be a power of 2 (max 256)
+#ifndef USART_LCD_BUFFER_SIZE
+#define USART_LCD_BUFFER_SIZE 64
+#endif
+// Bytes the owner may send while the other side waits
+#ifndef USART_BURST
+#define USART_BURST 16
+#endif
+// Pin routing TXD to the LCD (high) or the host (low), through an external
+// switch. Required: without it each peer gets the other's bytes, at the wrong
+// baud rate or as garbage commands. Define all 3, e.g.:
+// #define USART_LCD_SELECT_DDR DDRB
+// #define USART_LCD_SELECT_PORT PORTB
+// #define USART_LCD_SELECT_PIN PB1 // The software serial LCD TX, free with the USART
+#if !defined(USART_LCD_SELECT_DDR) || !defined(USART_LCD_SELECT_PORT) || !defined(USART_LCD_SELECT_PIN)
+#error "LCD_USE_USART needs the TXD select pin: define USART_LCD_SELECT_DDR, USART_LCD_SELECT_PORT and USART_LCD_SELECT_PIN"
+#endif
+
+#define USART_HOST_UBRR ((uint16_t)(F_CPU / (16UL * BAUDRATE)) - 1)
+#define USART_LCD_UBRR ((uint16_t)(F_CPU / (16UL * USART_LCD_BAUDRATE)) - 1)
+// LCD queue entries with this flag make the LCD wait (entry & ~flag) ms instead of sending a byte
+#define USART_LCD_IDLE_FLAG 0x8000
+
+typedef enum {
+    USART_OWNER_HOST,
+    USART_OWNER_LCD,
+} UsartOwner;
+
+// LCD queue, filled by the main loop and emptied by the UDRE interrupt
+RING(usart_lcd, uint16_t, USART_LCD_BUFFER_SIZE);
+volatile uint8_t usart_owner = USART_OWNER_HOST; // Side the line is set for
+volatile uint8_t usart_switching = 0;   // Waiting for TXC to switch the line
+uint8_t usart_burst = 0;                // Bytes sent since the line was switched, saturated
+volatile uint8_t usart_lcd_waiting = 0; // The LCD is processing a command
+volatile uint16_t usart_lcd_until = 0;  // Tick ending the LCD wait
+#endif
+
+// Line being assembled by usartLineFeed()
+char usart_line[MAX_USART_RX+1];
+uint8_t usart_line_len = 0;
+uint8_t usart_line_drop = 0; // Set while skipping the end of a too long line
 
 /**
  * Configures the USART Peripheral
- * @note Must be called before any other USART function
+ * @note Must be called before any other USART function (and lcdInit() with LCD_USE_USART)
+ * @note Global interrupts must be enabled to receive data
 */
 void usartInit() {
-    const uint16_t baud_prescaler = (uint16_t) ((float)F_CPU / 16. * (float)BAUDRATE) - 1; // Calc the baud prescaler config
+    const uint16_t baud_prescaler = (uint16_t) (F_CPU / (16UL * BAUDRATE)) - 1; // Calc the baud prescaler config
     UBRRH = (baud_prescaler>>8) & 0x0F;
     UBRRL = baud_prescaler & 0xFF;
+    #ifdef LCD_USE_USART
+    USART_LCD_SELECT_DDR |= (1<<USART_LCD_SELECT_PIN);
+    USART_LCD_SELECT_PORT &= ~(1<<USART_LCD_SELECT_PIN); // Start on the host
+    #endif
 
-    UCSRB = (1<<RXCIE) | (1<<TXCIE); // Enable TX/RX interrupts
+    UCSRB = (1<<RXCIE); // Enable RX interrupt
     UCSRB |= (1<<RXEN) | (1<<TXEN); // Enable the tranceivers based on the buffers
     UCSRC = (1<<URSEL) | (1<<UCSZ0) | (1<<UCSZ1); // Set frame format: Async, 8data, 1stop, no parity
 }
 
+/**
+ * Stores each received byte in the RX ring buffer
+ * @note The byte is dropped if the buffer is full
+*/
+ISR(USART_RXC_vect) {
+    #ifdef LCD_USE_USART
+    uint8_t status = UCSRA;
+    char byte_ = UDR;
+    // Framing error, or sampled at the LCD baud rate: the byte is garbage
+    if ((status & (1<<FE)) || (USART_LCD_UBRR != USART_HOST_UBRR && usart_owner == USART_OWNER_LCD))
+        return;
+    #else
+    char byte_ = UDR;
+    #endif
+
+    if (RING_FULL(usart_rx)) {
+        usart_rx_overflow = 1;
+        return;
+    }
+    RING_PUT(usart_rx, byte_);
+}
+
+#ifdef LCD_USE_USART
+/**
+ * Sets the line for one side: baud rate and TXD switch pin
+ * @note The transmitter MUST be idle
+*/
+void usartSetOwner(uint8_t owner) {
+    uint16_t ubrr = owner == USART_OWNER_LCD ? USART_LCD_UBRR : USART_HOST_UBRR;
+    UBRRH = (ubrr>>8) & 0x0F;
+    UBRRL = ubrr & 0xFF;
+    if (owner == USART_OWNER_LCD)
+        USART_LCD_SELECT_PORT |= (1<<USART_LCD_SELECT_PIN);
+    else
+        USART_LCD_SELECT_PORT &= ~(1<<USART_LCD_SELECT_PIN);
+    usart_owner = owner;
+    usart_burst = 0;
+}
+
+/**
+ * Checks if the LCD has a byte to send, starting the waits at the head of its queue
+ * @returns Boolean, if the next LCD entry is a byte that can be sent now
+ * @note Only called from the USART interrupts
+*/
+uint8_t usartLcdReady() {
+    while (!usart_lcd_waiting && !RING_EMPTY(usart_lcd)) {
+        uint16_t entry = RING_PEEK(usart_lcd);
+        if (!(entry & USART_LCD_IDLE_FLAG))
+            return 1;
+
+        // +2: the last 2 bytes are still in the transmitter (~1ms), and the tick may come right away
+        usart_lcd_until = tickNow() + (entry & ~USART_LCD_IDLE_FLAG) + 2;
+        usart_lcd_waiting = 1;
+        RING_DROP(usart_lcd, 1);
+    }
+    return 0;
+}
+
+/**
+ * Sends the next byte of the side owning the line each time UDR is empty
+ * Starts a switch when the other side has to go first
+ * @note Disables itself once both sides are empty, or while switching
+*/
+ISR(USART_UDRE_vect) {
+    if (usart_switching) {
+        UCSRB &= ~(1<<UDRIE);
+        return;
+    }
+
+    uint8_t host = !RING_EMPTY(usart_tx);
+    uint8_t lcd = usartLcdReady();
+    uint8_t mine = usart_owner == USART_OWNER_LCD ? lcd : host;
+    uint8_t other = usart_owner == USART_OWNER_LCD ? host : lcd;
+
+    if (other && (!mine || usart_burst >= USART_BURST)) {
+        if (usart_burst != 0) {
+            // Let the last byte reach the current side, see USART_TXC_vect
+            UCSRB &= ~(1<<UDRIE);
+            UCSRB |= (1<<TXCIE);
+            usart_switching = 1;
+            return;
+        }
+        // Nothing sent since the last switch, the transmitter is idle
+        usartSetOwner(!usart_owner);
+        mine = 1;
+    }
+    if (!mine) {
+        UCSRB &= ~(1<<UDRIE);
+        return;
+    }
+
+    if (usart_burst < USART_BURST)
+        usart_burst++;
+    UCSRA |= (1<<TXC); // Cleared, set again once this byte is sent
+    if (usart_owner == USART_OWNER_LCD) {
+        uint16_t entry;
+        RING_GET(usart_lcd, entry);
+        UDR = entry;
+    } else {
+        char byte_;
+        RING_GET(usart_tx, byte_);
+        UDR = byte_;
+    }
+}
+
+/**
+ * Switches the line once the last byte of the previous owner is sent
+*/
+ISR(USART_TXC_vect) {
+    UCSRB &= ~(1<<TXCIE);
+    usartSetOwner(!usart_owner);
+    usart_switching = 0;
+    UCSRB |= (1<<UDRIE);
+}
+
+/**
+ * Ends the LCD waits
+ * MUST be called on each tick, from the tick interrupt
+*/
+void usartTick() {
+    if (usart_lcd_waiting && (int16_t)(tickNow() - usart_lcd_until) >= 0) {
+        usart_lcd_waiting = 0;
+        if (!RING_EMPTY(usart_lcd))
+            UCSRB |= (1<<UDRIE);
+    }
+}
+
+/**
+ * Adds an entry to the LCD queue and starts the transmission if needed
+ * @note Blocks while the queue is full, global interrupts must be enabled
+*/
+void usartLcdQueue(uint16_t entry) {
+    while (RING_FULL(usart_lcd))
+        halIdle();
+
+    RING_PUT(usart_lcd, entry);
+    UCSRB |= (1<<UDRIE);
+}
+
+/**
+ * Queues one byte for the LCD
+ * @note Only blocks if the LCD queue is full
+*/
+void usartLcdPutChar(char byte_) {
+    usartLcdQueue((uint8_t)byte_);
+}
+
+/**
+ * Queues a wait for the LCD, the next LCD bytes are sent after it
+ * The line goes to the host meanwhile
+ * @param ms The wait in ms
+*/
+void usartLcdIdle(uint8_t ms) {
+    if (ms != 0)
+        usartLcdQueue(USART_LCD_IDLE_FLAG | ms);
+}
+
+/**
+ * Get the free space in the LCD queue
+ * @returns The number of entries that can be queued without waiting
+*/
+uint8_t usartLcdFree() {
+    return RING_FREE(usart_lcd);
+}
+
+#else
+/**
+ * Sends the next byte of the TX ring buffer each time UDR is empty
+ * @note Disables itself once the buffer is empty
+*/
+ISR(USART_UDRE_vect) {
+    if (RING_EMPTY(usart_tx)) {
+        UCSRB &= ~(1<<UDRIE);
+        return;
+    }
+    char byte_;
+    RING_GET(usart_tx, byte_);
+    UCSRA |= (1<<TXC); // Cleared, set again once this byte is sent
+    UDR = byte_;
+}
+#endif
+
+/**
+ * Get the free space in the TX ring buffer
+ * @returns The number of bytes that can be sent without waiting
+*/
+uint8_t usartTxFree() {
+    return RING_FREE(usart_tx);
+}
+
+/**
+ * Waits until the TX ring buffer is sent, its last byte included
+ * @note Global interrupts must be enabled, and a byte must have been sent (TXC is only set once a byte left)
+*/
+void usartFlush() {
+    while (!RING_EMPTY(usart_tx) || (UCSRB & (1<<UDRIE)) || !(UCSRA & (1<<TXC)))
+        halIdle();
+}
+
 /**
  * Sends one byte through serial
- * @note Blocking function
+ * @note The byte is only queued, only blocks if the TX buffer is full
 */
 void usartPutChar(char byte_) {
-    while ( !( UCSRA & (1<<UDRE)) );
-    UDR = byte_;
+    while (RING_FULL(usart_tx))
+        halIdle();
+
+    RING_PUT(usart_tx, byte_);
+    UCSRB |= (1<<UDRIE); // Start the transmission
+}
+
+/**
+ * Sends a block of bytes through serial
+ * @param data The bytes
+ * @param length The number of bytes
+ * @note The bytes are queued by chunks of the free space, only blocks if the TX buffer is full
+*/
+void usartWrite(const void* data, uint8_t length) {
+    const char* bytes = data;
+    while (length) {
+        uint8_t chunk = RING_FREE(usart_tx);
+        if (chunk == 0) {
+            halIdle();
+            continue;
+        }
+        if (chunk > length)
+            chunk = length;
+
+        RING_WRITE(usart_tx, bytes, chunk);
+        UCSRB |= (1<<UDRIE); // Start the transmission
+        bytes += chunk;
+        length -= chunk;
+    }
 }
 
 /**
  * Sends a string through serial
- * @note Blocking function
+ * @note Only blocks if the TX buffer is full
 */
 void usartPrint(char* str) {
     for (size_t i=0; str[i] != '\0'; i++)
@@ -46,22 +370,74 @@ void usartPrint(char* str) {
 }
 
 /**
- * Checks if a byte is read to be read within the UART UDR register
- * @returns Boolean, if UDR (RX) is full
+ * Sends a string stored in flash through serial
+ * @param str The CString, in program memory (see PSTR())
+ * @note Only blocks if the TX buffer is full
+*/
+void usartPrint_P(const char* str) {
+    for (char c = pgm_read_byte(str); c != '\0'; c = pgm_read_byte(++str))
+        usartPutChar(c);
+}
+
+/**
+ * Checks if a received byte is waiting in the RX buffer
+ * @returns Boolean, if the RX buffer is not empty
 */
 char usartCharAvail() {
-    return (UCSRA & (1<<RXC));
+    return !RING_EMPTY(usart_rx);
 }
 
 /**
- * Read the content of UDR register
- * @returns The character contained in UDR
- * @note This function is blocking while the register is not filled
+ * Read the next byte from the RX buffer
+ * @returns The oldest received character
+ * @note This function is blocking while the buffer is empty
 */
 char usartReadChar() {
-    while ( !(UCSRA & (1<<RXC)) );
+    while (!usartCharAvail())
+        halIdle();
+
+    char byte_;
+    RING_GET(usart_rx, byte_);
+    return byte_;
+}
 
-    return UDR;
+/**
+ * Adds one received byte to the line being assembled
+ * @param byte_ The received byte
+ * @returns A pointer to the received line ('\n' and '\r' stripped, null terminated) on the end of a line, NULL otherwise
+ * @note The returned line is only valid until the next call
+ * @note Lines longer than MAX_USART_RX are truncated
+*/
+char* usartLineFeed(char byte_) {
+    if (byte_ == '\n') {
+        usart_line[usart_line_len] = '\0';
+        usart_line_len = 0;
+        usart_line_drop = 0;
+        return usart_line;
+    }
+    if (byte_ == '\r' || usart_line_drop)
+        return NULL;
+
+    usart_line[usart_line_len++] = byte_;
+    if (usart_line_len >= MAX_USART_RX)
+        usart_line_drop = 1;
+    return NULL;
+}
+
+/**
+ * Drops the line being assembled
+*/
+void usartLineReset() {
+    usart_line_len = 0;
+    usart_line_drop = 0;
+}
+
+/**
+ * Checks if a line is being assembled
+ * @returns Boolean, if some bytes of the current line were received
+*/
+uint8_t usartLinePending() {
+    return usart_line_len != 0 || usart_line_drop;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,411 @@
+/*
+ * test_main.c
+ *
+ * Created: 17/10/2026 01:00:57
+ * Author : agent
+ *
+ * Application tests, run on the simulated peripherals of src/hal_native.h:
+ *   pio test -e native
+ */
+
+#include <unity.h>
+
+// The firmware is one translation unit, its main() is renamed out of the way
+#define main firmwareMain
+#include "../../src/main.c"
+#undef main
+
+/**
+ * Runs the main loop for a simulated time
+ * @param us The time in us
+*/
+void testRun(uint32_t us) {
+  uint32_t end = hal_time_us + us;
+  while (hal_time_us < end) {
+    schedRun(tasks, TASK_COUNT);
+    powerIdle(tasks, TASK_COUNT);
+  }
+}
+
+/**
+ * Sends a text line from the host
+*/
+void testSendText(const char* line) {
+  for (; *line != '\0'; line++)
+    halSimReceive(*line);
+}
+
+/**
+ * Sends a binary frame from the host
+*/
+void testSendFrame(uint8_t type, const uint8_t* payload, uint8_t length) {
+  uint8_t crc = crc8Update(crc8Update(0, type), length);
+  halSimReceive(PROTO_SYNC);
+  halSimReceive(type);
+  halSimReceive(length);
+  for (uint8_t i = 0; i < length; i++) {
+    halSimReceive(payload[i]);
+    crc = crc8Update(crc, payload[i]);
+  }
+  halSimReceive(crc);
+}
+
+/**
+ * Sets the ADC readings seen by the control loops, as the scanner would
+ * @param volume The volume knob ADC value
+ * @param temp The LM335 ADC value
+*/
+void testAdc(uint16_t volume, uint16_t temp) {
+  adc_result[0] = volume << ADC_OVERSAMPLE_LOG2;
+  adc_result[1] = temp << ADC_OVERSAMPLE_LOG2;
+  hal_adc_input[0] = volume;
+  hal_adc_input[1] = temp;
+}
+
+/**
+ * Sets the fan speed seen by the tach sampler
+*/
+void testTach(uint16_t rpm) {
+  tach_count = rpm != 0 ? TACH_AVERAGE : 0;
+  tach_sum = rpm != 0 ? (TACH_RPM_K * TACH_AVERAGE + rpm / 2) / rpm : 0;
+  tach_new = 1;
+}
+
+void setUp(void) {
+  mute = 0;
+  source = 0;
+  menuSet(Stereo);
+  menuUpdateStatic();
+}
+
+void tearDown(void) {
+}
+
+// Volume =====================================
+void test_volume_to_step(void) {
+  TEST_ASSERT_EQUAL_UINT8(63, volumeToStep(0));
+  TEST_ASSERT_EQUAL_UINT8(0, volumeToStep(100));
+  for (uint8_t v = 1; v <= 100; v++)
+    TEST_ASSERT_TRUE(volumeToStep(v) <= volumeToStep(v - 1));
+}
+
+void test_volume_knob(void) {
+  testAdc(0, 700);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(0, volume_level);
+
+  testAdc(1023, 700);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(100, volume_level);
+
+  testAdc(512, 700);
+  testRun(100000);
+  TEST_ASSERT_UINT_WITHIN(1, 50, volume_level);
+
+  // The ends stay reachable despite the hysteresis
+  testAdc(1022, 700);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(100, volume_level);
+}
+
+void test_volume_hysteresis(void) {
+  testAdc(600, 700);
+  testRun(100000);
+  uint16_t adc = volume_adc;
+
+  // Jitter within VOLUME_HYSTERESIS is ignored
+  testAdc(600 + VOLUME_HYSTERESIS, 700);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT16(adc, volume_adc);
+  testAdc(600 - VOLUME_HYSTERESIS, 700);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT16(adc, volume_adc);
+
+  // The volume set by the host is kept while the knob does not move
+  uint8_t volume = 20;
+  testSendFrame(PROTO_VOLUME, &volume, 1);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(20, volume_level);
+
+  // A real move takes over
+  testAdc(700, 700);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(fixedScaleU10(700, 100), volume_level);
+}
+
+void test_volume_ramp(void) {
+  testAdc(0, 700);
+  testRun(500000);
+  TEST_ASSERT_EQUAL_UINT8(63, pot_stereo.step);
+
+  // The wiper moves by at most VOLUME_RAMP_STEP per update
+  testAdc(1023, 700);
+  uint8_t last = pot_stereo.step;
+  for (uint8_t i = 0; i < 64 && pot_stereo.step != 0; i++) {
+    handleVolume(0);
+    TEST_ASSERT_TRUE(last - pot_stereo.step <= VOLUME_RAMP_STEP);
+    TEST_ASSERT_TRUE(pot_stereo.step < last);
+    last = pot_stereo.step;
+  }
+  TEST_ASSERT_EQUAL_UINT8(0, pot_stereo.step);
+  TEST_ASSERT_EQUAL_UINT8(0, pot_mono.step);
+}
+
+// Menus ======================================
+void test_menu_stereo(void) {
+  volume_level = 42;
+  menuUpdateDynamic();
+  TEST_ASSERT_EQUAL_STRING_LEN("[Stereo]", lcd_fb[0], 8);
+  TEST_ASSERT_EQUAL_STRING_LEN("Volume:  42%", lcd_fb[2], 12);
+  TEST_ASSERT_EQUAL_STRING_LEN("Source: [RCA ]", lcd_fb[3], 14);
+
+  mute = 1;
+  source = 1;
+  menuUpdateDynamic();
+  TEST_ASSERT_EQUAL_STRING_LEN("Volume: MUTE", lcd_fb[2], 12);
+  TEST_ASSERT_EQUAL_STRING_LEN("Source: [Jack]", lcd_fb[3], 14);
+}
+
+void test_menu_fan(void) {
+  menuSet(Fan);
+  menuUpdateStatic();
+  fan_temp = 42;
+  fan_rpm = 3000;
+  fan_rpm_min = 1200;
+  menuUpdateDynamic();
+  TEST_ASSERT_EQUAL_STRING_LEN("[Fan]", lcd_fb[0], 5);
+  TEST_ASSERT_EQUAL_STRING_LEN("T: 42C RPM: 3000", lcd_fb[1], LCD_COLS);
+  TEST_ASSERT_EQUAL_STRING_LEN("Min RPM:    1200", lcd_fb[2], LCD_COLS);
+  // Half the bar is full
+  TEST_ASSERT_TRUE(lcd_fb[3][0] != lcd_fb[3][LCD_COLS - 1]);
+  TEST_ASSERT_EQUAL(lcd_fb[3][0], lcd_fb[3][LCD_COLS / 2 - 1]);
+}
+
+void test_menu_flush(void) {
+  volume_level = 77;
+  testRun(500000);
+  TEST_ASSERT_EQUAL_MEMORY(lcd_fb, lcd_glass, sizeof(lcd_fb));
+}
+
+// Host commands ==============================
+void test_ctitle(void) {
+  testSendText("cTitle Hello\n");
+  testRun(100000);
+  TEST_ASSERT_EQUAL_STRING("Hello", music_title);
+  TEST_ASSERT_EQUAL_STRING_LEN("Title: Hello    ", lcd_fb[1], LCD_COLS);
+
+  // Not a title command
+  testSendText("cTitle\n");
+  testSendText("xTitle Other\n");
+  testSendText("cTitleXYZ\n");
+  testRun(100000);
+  TEST_ASSERT_EQUAL_STRING("Hello", music_title);
+
+  // Too long, truncated to the buffer
+  testSendText("cTitle 0123456789012345678901234567890123456789012345678901234567890123456789\n");
+  testRun(200000);
+  TEST_ASSERT_EQUAL(sizeof(music_title) - 1, strlen(music_title));
+  TEST_ASSERT_EQUAL_STRING_LEN("0123456789", music_title, 10);
+}
+
+void test_stray_byte(void) {
+  // A byte without its line does not hold off the frames for good
+  testSendText("x");
+  testRun(HOST_LINE_TIMEOUT * 2000UL);
+  uint8_t volume = 33;
+  testSendFrame(PROTO_VOLUME, &volume, 1);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(33, volume_level);
+
+  testSendText("cTitle Next\n");
+  testRun(100000);
+  TEST_ASSERT_EQUAL_STRING("Next", music_title);
+
+  // A frame cut after its length does not swallow the next commands
+  halSimReceive(PROTO_SYNC);
+  halSimReceive(PROTO_VOLUME);
+  halSimReceive(1);
+  testRun(HOST_LINE_TIMEOUT * 2000UL);
+  volume = 44;
+  testSendFrame(PROTO_VOLUME, &volume, 1);
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT8(44, volume_level);
+
+  // Within a line, the sync byte is text (UTF-8)
+  testSendText("cTitle \xC3\xA5\n");
+  testRun(100000);
+  TEST_ASSERT_EQUAL_STRING("\xC3\xA5", music_title);
+}
+
+// Fan ========================================
+void test_fan_target(void) {
+  // 10C (default calibration, 50C full scale) and the fan at the target speed
+  testAdc(512, 205);
+  tempCalChanged();
+  pidReset(&fan_pid);
+  testTach(1800);
+  handleFan(&fan_rpm, 1200);
+  TEST_ASSERT_EQUAL_UINT8(10, fan_temp);
+  TEST_ASSERT_UINT_WITHIN(3, 1800, fan_rpm);
+  TEST_ASSERT_UINT_WITHIN(2, 255UL * 1800 / FAN_RPM_MAX, OCR0); // Only the feedforward
+
+  // 40C
+  testAdc(512, 819);
+  tempCalChanged();
+  pidReset(&fan_pid);
+  testTach(3600);
+  handleFan(&fan_rpm, 1200);
+  TEST_ASSERT_EQUAL_UINT8(40, fan_temp);
+  TEST_ASSERT_UINT_WITHIN(2, 255UL * 3600 / FAN_RPM_MAX, OCR0);
+}
+
+void test_fan_pwm_correction(void) {
+  testAdc(512, 614); // 30C, 3000 rpm
+  tempCalChanged();
+
+  // Too slow: more than the feedforward
+  pidReset(&fan_pid);
+  testTach(2000);
+  handleFan(&fan_rpm, 1200);
+  uint8_t slow = OCR0;
+  TEST_ASSERT_GREATER_THAN(255UL * 3000 / FAN_RPM_MAX + 2, slow);
+
+  // Too fast: less than the feedforward
+  pidReset(&fan_pid);
+  testTach(4000);
+  handleFan(&fan_rpm, 1200);
+  TEST_ASSERT_LESS_THAN(255UL * 3000 / FAN_RPM_MAX - 2, OCR0);
+
+  // Stopped: more than too slow
+  pidReset(&fan_pid);
+  testTach(0);
+  handleFan(&fan_rpm, 1200);
+  TEST_ASSERT_GREATER_THAN(slow, OCR0);
+}
+
+void test_tach_limits(void) {
+  // A period of a few samples does not wrap around
+  tach_sum = 2;
+  tach_count = TACH_AVERAGE;
+  tach_new = 1;
+  TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, tachGetRpm());
+
+  // 3000 rpm with a glitch after each rising edge
+  uint16_t period = TACH_RPM_K / 3000;
+  tach_valid = 0;
+  tach_window = 0;
+  tach_elapsed = 0;
+  tach_last = 0;
+  for (uint8_t n = 0; n < 2 * TACH_AVERAGE; n++) {
+    for (uint16_t i = 0; i < period; i++) {
+      uint8_t high = i < period / 2 && i != 2;
+      PINB = high ? PINB | (1 << PB0) : PINB & ~(1 << PB0);
+      TIMER0_OVF_vect();
+    }
+  }
+  TEST_ASSERT_UINT_WITHIN(30, 3000, tachGetRpm());
+  testTach(0);
+}
+
+// Profiler ===================================
+void test_prof_saturation(void) {
+  profReset();
+  ProfEntry* entry = &prof_table[PROF_BUTTONS];
+  entry->count = UINT16_MAX - 1;
+
+  profRecord(PROF_BUTTONS, 10, 100);
+  uint32_t sum = entry->sum;
+  TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, entry->count);
+
+  // Once the count saturates, the extremes and overruns are still recorded
+  profRecord(PROF_BUTTONS, 200, 100);
+  profRecord(PROF_BUTTONS, 5, 100);
+  TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, entry->count);
+  TEST_ASSERT_EQUAL_UINT32(sum, entry->sum);
+  TEST_ASSERT_EQUAL_UINT16(5, entry->min);
+  TEST_ASSERT_EQUAL_UINT16(200, entry->max);
+  TEST_ASSERT_EQUAL_UINT16(1, entry->overruns);
+  profReset();
+}
+
+char test_tx[512]; // Bytes sent by the firmware
+uint16_t test_tx_len = 0;
+void testTxHook(uint8_t byte_) {
+  if (test_tx_len < sizeof(test_tx) - 1)
+    test_tx[test_tx_len++] = byte_;
+}
+
+void test_prof_dump(void) {
+  Task* host = NULL;
+  for (uint8_t i = 0; i < TASK_COUNT; i++)
+    if (tasks[i].run == taskHost)
+      host = &tasks[i];
+  uint16_t overruns = host->overruns;
+
+  telemetry_period = 0;
+  test_tx_len = 0;
+  hal_tx_hook = testTxHook;
+  testSendText("cProf\n");
+  testRun(1000000);
+  hal_tx_hook = NULL;
+  telemetry_period = 10;
+  test_tx[test_tx_len] = '\0';
+
+  // Every section is sent, without stalling the host task
+  TEST_ASSERT_EQUAL_UINT16(overruns, host->overruns);
+  char* line = test_tx;
+  for (uint8_t i = 0; i < PROF_OVERFLOW; i++) {
+    TEST_ASSERT_EQUAL_STRING_LEN("prof ", line, 5);
+    line = strchr(line, '\n');
+    TEST_ASSERT_NOT_NULL(line);
+    line++;
+  }
+  TEST_ASSERT_EQUAL_STRING("", line);
+}
+
+// Settings ===================================
+void test_settings_too_large(void) {
+  static uint8_t big[SETTINGS_DATA_MAX + 1];
+  static const Setting table[] PROGMEM = {
+    SETTING(big),
+  };
+
+  // Rejected, nothing loaded nor saved
+  uint32_t writes = hal_eeprom_writes;
+  TEST_ASSERT_FALSE(settingsInit(table, 1));
+  TEST_ASSERT_EQUAL_UINT8(0, settings_length);
+  memset(big, 0x55, sizeof(big));
+  for (uint8_t i = 0; i < SETTINGS_DELAY + 2; i++)
+    settingsUpdate();
+  testRun(100000);
+  TEST_ASSERT_EQUAL_UINT32(writes, hal_eeprom_writes);
+
+  settingsInit(settings, SETTINGS_COUNT);
+  TEST_ASSERT_TRUE(settings_length > 0 && settings_length <= SETTINGS_DATA_MAX);
+}
+
+int main(void) {
+  initGpio();
+  sei();
+  usartInit();
+  lcdInit();
+  menuInit(&menu, menu_screens);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_volume_to_step);
+  RUN_TEST(test_volume_knob);
+  RUN_TEST(test_volume_hysteresis);
+  RUN_TEST(test_volume_ramp);
+  RUN_TEST(test_menu_stereo);
+  RUN_TEST(test_menu_fan);
+  RUN_TEST(test_menu_flush);
+  RUN_TEST(test_ctitle);
+  RUN_TEST(test_stray_byte);
+  RUN_TEST(test_fan_target);
+  RUN_TEST(test_fan_pwm_correction);
+  RUN_TEST(test_tach_limits);
+  RUN_TEST(test_prof_saturation);
+  RUN_TEST(test_prof_dump);
+  RUN_TEST(test_settings_too_large);
+  return UNITY_END();
+}
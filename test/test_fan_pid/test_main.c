@@ -0,0 +1,200 @@
+/*
+ * test_main.c
+ *
+ * Created: 17/10/2026 01:12:30
+ * Author : agent
+ *
+ * Fan controller regression tests against a simulated fan and thermal plant:
+ *   pio test -e native
+ * handleFan() runs at its 4Hz task rate, the plant is integrated in between.
+ */
+
+#include <unity.h>
+
+// The firmware is one translation unit, its main() is renamed out of the way
+#define main firmwareMain
+#include "../../src/main.c"
+#undef main
+
+#define TEST_FAN_HZ 4        // handleFan() rate, see the task table
+#define TEST_PLANT_STEPS 10  // Plant steps per handleFan() call
+
+/**
+ * Fan and heatsink model
+ * - The fan reaches plant_full_rpm at plant_full_duty, and follows its
+ *   steady speed with a first order lag of plant_fan_tau s
+ * - The heatsink gets plant_power, and loses heat to the ambient air faster
+ *   as the fan spins up
+*/
+float plant_full_duty = 170; // 2/3 duty
+float plant_full_rpm = FAN_RPM_MAX;
+float plant_fan_tau = 1.0;   // s
+float plant_rpm = 0;
+float plant_temp = 25;       // C
+float plant_ambient = 25;    // C
+float plant_power = 0;       // C/s of heating
+float plant_cooling = 0.02;  // 1/s at 0 rpm, doubled every 1000 rpm
+uint8_t plant_stalled = 0;   // The rotor is blocked
+
+/**
+ * Moves the plant forward by one handleFan() period, at the current PWM
+*/
+void plantStep() {
+  float dt = 1.0 / TEST_FAN_HZ / TEST_PLANT_STEPS;
+  for (uint8_t i = 0; i < TEST_PLANT_STEPS; i++) {
+    float target = OCR0 >= plant_full_duty ? plant_full_rpm : OCR0 * plant_full_rpm / plant_full_duty;
+    if (plant_stalled)
+      target = 0;
+    plant_rpm += (target - plant_rpm) * dt / plant_fan_tau;
+
+    float cooling = plant_cooling * (1 + plant_rpm / 1000);
+    plant_temp += (plant_power - cooling * (plant_temp - plant_ambient)) * dt;
+  }
+}
+
+/**
+ * Gives the plant outputs to the firmware: LM335 reading (default
+ * calibration, 50C full scale) and tach
+*/
+void plantSense() {
+  float raw = plant_temp * 1023 / 50;
+  if (raw < 1) raw = 1;
+  if (raw > 1023) raw = 1023;
+  adc_result[1] = (uint16_t)(raw + 0.5) << ADC_OVERSAMPLE_LOG2;
+  adc_result[0] = 512 << ADC_OVERSAMPLE_LOG2;
+
+  uint16_t rpm = plant_rpm + 0.5;
+  tach_count = rpm >= 100 ? TACH_AVERAGE : 0;
+  tach_sum = rpm >= 100 ? (TACH_RPM_K * TACH_AVERAGE + rpm / 2) / rpm : 0;
+  tach_new = 1;
+}
+
+/**
+ * Runs the closed loop
+ * @param seconds The simulated time
+*/
+void plantRun(float seconds) {
+  for (uint16_t n = seconds * TEST_FAN_HZ; n > 0; n--) {
+    plantSense();
+    handleFan(&fan_rpm, fan_rpm_min);
+    plantStep();
+  }
+}
+
+/**
+ * Holds the heatsink at a temperature, with no heating
+*/
+void plantHoldTemp(float temp) {
+  plant_temp = temp;
+  plant_ambient = temp;
+  plant_power = 0;
+}
+
+/**
+ * Gives the fan target of the firmware for a temperature
+*/
+float plantTarget(float temp) {
+  return temp * (FAN_RPM_MAX - fan_rpm_min) / FAN_TEMP_MAX + fan_rpm_min;
+}
+
+void setUp(void) {
+  plant_full_duty = 170;
+  plant_rpm = 0;
+  plant_stalled = 0;
+  plant_cooling = 0.02;
+  fan_rpm_min = FAN_RPM_MIN;
+  OCR0 = 0;
+  pidReset(&fan_pid);
+  tempCalChanged();
+}
+
+void tearDown(void) {
+}
+
+// The feedforward assumes full speed at full duty, this fan gets there at 2/3:
+// the integral must go negative to trim it
+void test_trims_overestimated_feedforward(void) {
+  plantHoldTemp(30);
+  plantRun(30);
+  TEST_ASSERT_UINT_WITHIN(plantTarget(30) * 0.02, plantTarget(30), fan_rpm);
+  TEST_ASSERT_TRUE(fan_pid.integral < 0);
+}
+
+// A fan weaker than the feedforward model: the integral goes positive
+void test_trims_underestimated_feedforward(void) {
+  plant_full_rpm = FAN_RPM_MAX * 0.7;
+  plant_full_duty = 255;
+  plantHoldTemp(30);
+  plantRun(30);
+  plant_full_rpm = FAN_RPM_MAX;
+  TEST_ASSERT_UINT_WITHIN(plantTarget(30) * 0.02, plantTarget(30), fan_rpm);
+  TEST_ASSERT_TRUE(fan_pid.integral > 0);
+}
+
+// Target step 20C -> 40C: bounded overshoot and settling time
+void test_step_response(void) {
+  plantHoldTemp(20);
+  plantRun(30);
+
+  plantHoldTemp(40);
+  float target = plantTarget(40);
+  uint16_t peak = 0;
+  float settled = -1;
+  for (uint16_t n = 0; n < 30 * TEST_FAN_HZ; n++) {
+    plantSense();
+    handleFan(&fan_rpm, fan_rpm_min);
+    plantStep();
+
+    if (fan_rpm > peak)
+      peak = fan_rpm;
+    uint8_t inside = fan_rpm > target * 0.97 && fan_rpm < target * 1.03;
+    if (!inside)
+      settled = -1;
+    else if (settled < 0)
+      settled = (float)n / TEST_FAN_HZ;
+  }
+
+  TEST_ASSERT_TRUE_MESSAGE(settled >= 0, "never settled within 3%");
+  TEST_ASSERT_TRUE_MESSAGE(settled <= 10, "settling time over 10s");
+  TEST_ASSERT_LESS_OR_EQUAL(target * 1.10, peak);
+}
+
+// The output reaches full power when the fan cannot follow
+void test_saturates_stalled_fan(void) {
+  plantHoldTemp(30);
+  plant_stalled = 1;
+  plantRun(10);
+  TEST_ASSERT_EQUAL_UINT8(255, OCR0);
+  // No windup: the integral stopped where the output saturated, at most the
+  // whole headroom above the feedforward
+  TEST_ASSERT_LESS_OR_EQUAL((255L - 255L * 3000 / FAN_RPM_MAX) << 8, fan_pid.integral);
+
+  // Back on target once freed
+  plant_stalled = 0;
+  plantRun(20);
+  TEST_ASSERT_UINT_WITHIN(plantTarget(30) * 0.03, plantTarget(30), fan_rpm);
+}
+
+// Heated heatsink: the temperature settles, and the fan tracks its target
+void test_thermal_loop(void) {
+  plant_temp = 25;
+  plant_ambient = 25;
+  plant_power = 0.5; // ~50C above ambient with a stopped fan
+  plantRun(300);
+
+  float temp = plant_temp;
+  plantRun(30);
+  TEST_ASSERT_TRUE(plant_temp > plant_ambient);
+  TEST_ASSERT_TRUE(plant_temp - temp < 0.2 && temp - plant_temp < 0.2);
+  TEST_ASSERT_UINT_WITHIN(plantTarget(plant_temp) * 0.03, plantTarget(plant_temp), fan_rpm);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_trims_overestimated_feedforward);
+  RUN_TEST(test_trims_underestimated_feedforward);
+  RUN_TEST(test_step_response);
+  RUN_TEST(test_saturates_stalled_fan);
+  RUN_TEST(test_thermal_loop);
+  return UNITY_END();
+}
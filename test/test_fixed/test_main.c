@@ -0,0 +1,93 @@
+/*
+ * test_main.c
+ *
+ * Created: 17/10/2026 01:16:26
+ * Author : agent
+ *
+ * Fixed point helper tests, on the host:
+ *   pio test -e native
+ */
+
+#include <unity.h>
+#include "../../src/fixed.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_sat_add_sub(void) {
+  TEST_ASSERT_EQUAL_INT16(-200, satAdd16(100, -300));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, satAdd16(30000, 30000));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, satAdd16(-30000, -30000));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, satAdd16(INT16_MAX, 1));
+  TEST_ASSERT_EQUAL_INT16(400, satSub16(100, -300));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, satSub16(-30000, 30000));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, satSub16(0, INT16_MIN));
+}
+
+void test_q88_from_int(void) {
+  TEST_ASSERT_EQUAL_INT16(1280, q88FromInt(5));
+  TEST_ASSERT_EQUAL_INT16(-1280, q88FromInt(-5));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, q88FromInt(-128));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(127), q88FromInt(127));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, q88FromInt(128));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, q88FromInt(-129));
+}
+
+void test_q88_mul(void) {
+  TEST_ASSERT_EQUAL_INT16(Q8_8(3), q88Mul(Q8_8(1.5), Q8_8(2)));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(-3), q88Mul(Q8_8(-1.5), Q8_8(2)));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(3), q88Mul(Q8_8(-1.5), Q8_8(-2)));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(-0.25), q88Mul(Q8_8(0.5), Q8_8(-0.5)));
+
+  // Rounded to the nearest, halves upwards
+  TEST_ASSERT_EQUAL_INT16(1, q88Mul(1, Q8_8(0.5)));
+  TEST_ASSERT_EQUAL_INT16(0, q88Mul(-1, Q8_8(0.5)));
+  TEST_ASSERT_EQUAL_INT16(0, q88Mul(1, Q8_8(0.25)));
+  TEST_ASSERT_EQUAL_INT16(-1, q88Mul(-3, Q8_8(0.25)));
+
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, q88Mul(Q8_8(100), Q8_8(2)));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, q88Mul(Q8_8(-100), Q8_8(2)));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, q88Mul(INT16_MIN, INT16_MIN));
+}
+
+void test_q88_div(void) {
+  TEST_ASSERT_EQUAL_INT16(Q8_8(1.5), q88Div(Q8_8(3), Q8_8(2)));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(-1.5), q88Div(Q8_8(-3), Q8_8(2)));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(-1.5), q88Div(Q8_8(3), Q8_8(-2)));
+  TEST_ASSERT_EQUAL_INT16(Q8_8(1.5), q88Div(Q8_8(-3), Q8_8(-2)));
+
+  // Truncated towards 0
+  TEST_ASSERT_EQUAL_INT16(85, q88Div(Q8_8(1), Q8_8(3)));
+  TEST_ASSERT_EQUAL_INT16(-85, q88Div(Q8_8(-1), Q8_8(3)));
+  TEST_ASSERT_EQUAL_INT16(0, q88Div(1, Q8_8(2)));
+
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, q88Div(Q8_8(100), Q8_8(0.5)));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, q88Div(Q8_8(-100), Q8_8(0.5)));
+  TEST_ASSERT_EQUAL_INT16(INT16_MAX, q88Div(Q8_8(1), 0));
+  TEST_ASSERT_EQUAL_INT16(INT16_MIN, q88Div(Q8_8(-1), 0));
+}
+
+void test_q1616_mul(void) {
+  TEST_ASSERT_EQUAL_INT32(Q16_16(-3), q1616Mul(Q16_16(1.5), Q16_16(-2)));
+  TEST_ASSERT_EQUAL_INT32(Q16_16(3), q1616Mul(Q16_16(-1.5), Q16_16(-2)));
+  TEST_ASSERT_EQUAL_INT32(Q16_16(1000000. / 65536), q1616Mul(Q16_16(1000), Q16_16(1000. / 65536)));
+  TEST_ASSERT_EQUAL_INT32(Q16_16(-30000), q1616Mul(Q16_16(300), Q16_16(-100)));
+
+  // Rounded to the nearest, halves upwards
+  TEST_ASSERT_EQUAL_INT32(1, q1616Mul(1, Q16_16(0.5)));
+  TEST_ASSERT_EQUAL_INT32(0, q1616Mul(-1, Q16_16(0.5)));
+  TEST_ASSERT_EQUAL_INT32(-1, q1616Mul(-3, Q16_16(0.25)));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sat_add_sub);
+  RUN_TEST(test_q88_from_int);
+  RUN_TEST(test_q88_mul);
+  RUN_TEST(test_q88_div);
+  RUN_TEST(test_q1616_mul);
+  return UNITY_END();
+}
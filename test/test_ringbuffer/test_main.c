@@ -0,0 +1,138 @@
+/*
+ * test_main.c
+ *
+ * Created: 17/10/2026 01:04:01
+ * Author : agent
+ *
+ * Ring buffer tests, on the host:
+ *   pio test -e native
+ */
+
+#include <unity.h>
+#include "../../src/ringbuffer.h"
+
+RING(ring8, uint8_t, 8);
+RING(ring16, uint16_t, 256);
+
+void setUp(void) {
+  ring8.head = ring8.tail = 0;
+  ring16.head = ring16.tail = 0;
+}
+
+void tearDown(void) {
+}
+
+void test_empty(void) {
+  TEST_ASSERT_TRUE(RING_EMPTY(ring8));
+  TEST_ASSERT_FALSE(RING_FULL(ring8));
+  TEST_ASSERT_EQUAL_UINT8(0, RING_COUNT(ring8));
+  TEST_ASSERT_EQUAL_UINT8(7, RING_FREE(ring8));
+}
+
+// One entry stays unused: full at size - 1
+void test_full(void) {
+  for (uint8_t i = 0; i < 7; i++) {
+    TEST_ASSERT_FALSE(RING_FULL(ring8));
+    RING_PUT(ring8, i);
+  }
+  TEST_ASSERT_TRUE(RING_FULL(ring8));
+  TEST_ASSERT_FALSE(RING_EMPTY(ring8));
+  TEST_ASSERT_EQUAL_UINT8(7, RING_COUNT(ring8));
+  TEST_ASSERT_EQUAL_UINT8(0, RING_FREE(ring8));
+
+  uint8_t x;
+  RING_GET(ring8, x);
+  TEST_ASSERT_EQUAL_UINT8(0, x);
+  TEST_ASSERT_FALSE(RING_FULL(ring8));
+  TEST_ASSERT_EQUAL_UINT8(1, RING_FREE(ring8));
+}
+
+// Single entries keep their order across many wrap-arounds
+void test_put_get_wrap(void) {
+  uint8_t in = 0, out = 0;
+  for (uint16_t k = 0; k < 1000; k++) {
+    RING_PUT(ring8, in++);
+    if (k % 3 == 0)
+      RING_PUT(ring8, in++);
+    while (RING_COUNT(ring8) > 4) {
+      uint8_t x;
+      RING_GET(ring8, x);
+      TEST_ASSERT_EQUAL_UINT8(out++, x);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT8((uint8_t)(in - out), RING_COUNT(ring8));
+}
+
+// Bulk writes and reads of every length, straddling the end of the buffer
+void test_write_read_wrap(void) {
+  uint8_t in = 0, out = 0, tmp[8];
+  for (uint16_t k = 0; k < 1000; k++) {
+    uint8_t n = k % 8;
+    if (n > RING_FREE(ring8))
+      n = RING_FREE(ring8);
+    for (uint8_t i = 0; i < n; i++)
+      tmp[i] = in++;
+    RING_WRITE(ring8, tmp, n);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)(in - out), RING_COUNT(ring8));
+
+    uint8_t m = (k * 3) % 5;
+    if (m > RING_COUNT(ring8))
+      m = RING_COUNT(ring8);
+    RING_READ(ring8, tmp, m);
+    for (uint8_t i = 0; i < m; i++)
+      TEST_ASSERT_EQUAL_UINT8(out++, tmp[i]);
+  }
+}
+
+// Peeked entries stay in the ring until dropped
+void test_peek_drop(void) {
+  ring8.head = ring8.tail = 6; // Wraps after 2 entries
+  uint8_t src[5] = {10, 11, 12, 13, 14};
+  RING_WRITE(ring8, src, 5);
+
+  TEST_ASSERT_EQUAL_UINT8(10, RING_PEEK(ring8));
+  for (uint8_t i = 0; i < 5; i++)
+    TEST_ASSERT_EQUAL_UINT8(10 + i, RING_PEEK_AT(ring8, i));
+  TEST_ASSERT_EQUAL_UINT8(5, RING_COUNT(ring8));
+
+  RING_DROP(ring8, 3);
+  TEST_ASSERT_EQUAL_UINT8(2, RING_COUNT(ring8));
+  TEST_ASSERT_EQUAL_UINT8(13, RING_PEEK(ring8));
+  TEST_ASSERT_EQUAL_UINT8(14, RING_PEEK_AT(ring8, 1));
+}
+
+// 256 entries: the 8 bit indexes wrap by themselves, wider entries
+void test_max_size(void) {
+  for (uint16_t i = 0; i < 255; i++) {
+    TEST_ASSERT_FALSE(RING_FULL(ring16));
+    RING_PUT(ring16, i * 300);
+  }
+  TEST_ASSERT_TRUE(RING_FULL(ring16));
+  TEST_ASSERT_EQUAL_UINT8(255, RING_COUNT(ring16));
+  TEST_ASSERT_EQUAL_UINT8(0, RING_FREE(ring16));
+
+  for (uint16_t i = 0; i < 255; i++) {
+    uint16_t x;
+    RING_GET(ring16, x);
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)(i * 300), x);
+  }
+  TEST_ASSERT_TRUE(RING_EMPTY(ring16));
+  TEST_ASSERT_EQUAL_UINT8(255, ring16.tail);
+
+  RING_PUT(ring16, 0xBEEF);
+  RING_PUT(ring16, 0xCAFE);
+  TEST_ASSERT_EQUAL_UINT8(1, ring16.head);
+  TEST_ASSERT_EQUAL_UINT16(0xBEEF, RING_PEEK(ring16));
+  TEST_ASSERT_EQUAL_UINT16(0xCAFE, RING_PEEK_AT(ring16, 1));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty);
+  RUN_TEST(test_full);
+  RUN_TEST(test_put_get_wrap);
+  RUN_TEST(test_write_read_wrap);
+  RUN_TEST(test_peek_drop);
+  RUN_TEST(test_max_size);
+  return UNITY_END();
+}
@@ -0,0 +1,219 @@
+/*
+ * telemetry_decode.cpp
+ *
+ * Created: 17/10/2026 00:34:24
+ * Author : agent
+ *
+ * Decodes the binary frames sent by the amplifier (see src/protocol.h)
+ *
+ * Build: g++ -std=c++17 -O2 -o telemetry_decode tools/telemetry_decode.cpp
+ * Usage: telemetry_decode [-b <baud>] <device|file|->
+ *   - A serial device or pty is configured to <baud> (default 9600), 8N1, raw.
+ *     Use -b 19200 for a build with LCD_USE_USART, where the host shares the
+ *     LCD baud rate
+ *   - A file (e.g. a capture) is decoded up to its end, - reads stdin
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint8_t kSync = 0xA5;
+constexpr uint8_t kReply = 0x80;
+constexpr uint8_t kTempCal = 0x07;
+constexpr uint8_t kStatus = 0x10;
+constexpr uint8_t kGetTitle = 0x11;
+constexpr uint8_t kTelemetry = 0x20;
+constexpr size_t kMaxPayload = 64;
+
+/**
+ * Updates a CRC-8 (poly 0x07) with one byte, same as crc8Update() in the firmware
+ */
+uint8_t crc8Update(uint8_t crc, uint8_t byte) {
+  crc ^= byte;
+  for (int i = 0; i < 8; i++)
+    crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+  return crc;
+}
+
+uint16_t readU16(const std::vector<uint8_t>& p, size_t i) {
+  return p[i] | p[i + 1] << 8;
+}
+
+/**
+ * Incremental frame parser, bytes outside of frames are collected as text lines
+ */
+class FrameParser {
+ public:
+  /**
+   * Feeds one byte, prints the frames and text lines as they complete
+   */
+  void feed(uint8_t byte) {
+    switch (state_) {
+      case State::kSync:
+        if (byte == kSync) {
+          // The firmware text is ASCII, a sync byte ends a partial line (noise
+          // on the line, a reset mid-print) instead of hiding the next frames
+          if (!text_.empty()) {
+            printf("text %s\n", text_.c_str());
+            text_.clear();
+          }
+          crc_ = 0;
+          state_ = State::kType;
+        } else if (byte == '\n') {
+          printf("text %s\n", text_.c_str());
+          text_.clear();
+        } else if (byte != '\r') {
+          text_ += static_cast<char>(byte);
+        }
+        break;
+      case State::kType:
+        type_ = byte;
+        crc_ = crc8Update(crc_, byte);
+        state_ = State::kLength;
+        break;
+      case State::kLength:
+        if (byte > kMaxPayload) {
+          printf("error length %u\n", byte);
+          state_ = State::kSync;
+          break;
+        }
+        crc_ = crc8Update(crc_, byte);
+        length_ = byte;
+        payload_.clear();
+        state_ = length_ ? State::kPayload : State::kCrc;
+        break;
+      case State::kPayload:
+        payload_.push_back(byte);
+        crc_ = crc8Update(crc_, byte);
+        if (payload_.size() >= length_)
+          state_ = State::kCrc;
+        break;
+      case State::kCrc:
+        state_ = State::kSync;
+        if (byte != crc_) {
+          printf("error crc type 0x%02X\n", type_);
+          break;
+        }
+        print();
+        break;
+    }
+    fflush(stdout);
+  }
+
+ private:
+  enum class State { kSync, kType, kLength, kPayload, kCrc };
+
+  void print() const {
+    const std::vector<uint8_t>& p = payload_;
+    if (type_ == kTelemetry && p.size() >= 11) {
+      printf("telemetry temp=%uC rpm=%u pwm=%u volume=%u%% mute=%u source=%s bass=%u dist=%u menu=%u loop_max=%uus overruns=%u\n",
+             p[0], readU16(p, 1), p[3], p[4], p[5] & 1, p[5] & 2 ? "jack" : "rca", (p[5] >> 2) & 1, (p[5] >> 3) & 1,
+             p[6], readU16(p, 7), readU16(p, 9));
+      if (p.size() >= 13)
+        printf("telemetry load=%u.%u%%\n", readU16(p, 11) / 10, readU16(p, 11) % 10);
+      if (p.size() >= 15)
+        printf("telemetry level_rms=%u level_peak=%u\n", p[13], p[14]);
+    } else if (type_ == (kStatus | kReply) && p.size() >= 8) {
+      printf("status volume=%u%% mute=%u source=%s effects=%u menu=%u temp=%uC rpm=%u\n",
+             p[0], p[1], p[2] ? "jack" : "rca", p[3], p[4], p[5], readU16(p, 6));
+    } else if (type_ == (kTempCal | kReply) && p.size() >= 12) {
+      printf("tempcal offset=%.2fC gain=%u coupling=%.4f adc0_sum=%u adc1_sum=%u temp=%.2fC\n",
+             static_cast<int16_t>(readU16(p, 0)) / 256., readU16(p, 2), static_cast<int16_t>(readU16(p, 4)) / 32768.,
+             readU16(p, 6), readU16(p, 8), static_cast<int16_t>(readU16(p, 10)) / 256.);
+    } else if (type_ == (kGetTitle | kReply)) {
+      printf("title %s\n", std::string(p.begin(), p.end()).c_str());
+    } else {
+      printf("frame type=0x%02X length=%zu\n", type_, p.size());
+    }
+  }
+
+  State state_ = State::kSync;
+  uint8_t type_ = 0;
+  uint8_t length_ = 0;
+  uint8_t crc_ = 0;
+  std::vector<uint8_t> payload_;
+  std::string text_;
+};
+
+/**
+ * Gets the termios speed of a baud rate
+ * @returns B0 for a rate termios does not support
+ */
+speed_t baudToSpeed(long baud) {
+  switch (baud) {
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return B0;
+  }
+}
+
+/**
+ * Configures a serial device or pty for the amplifier link
+ */
+bool configureTty(int fd, speed_t speed) {
+  termios tty{};
+  if (tcgetattr(fd, &tty) != 0)
+    return false;
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+  return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  speed_t speed = B9600;
+  int arg = 1;
+  if (argc == 4 && strcmp(argv[1], "-b") == 0) {
+    speed = baudToSpeed(strtol(argv[2], nullptr, 10));
+    if (speed == B0) {
+      fprintf(stderr, "unsupported baud rate %s\n", argv[2]);
+      return 2;
+    }
+    arg = 3;
+  } else if (argc != 2) {
+    fprintf(stderr, "usage: %s [-b <baud>] <device|file|->\n", argv[0]);
+    return 2;
+  }
+
+  const char* path = argv[arg];
+  int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    return 1;
+  }
+  if (isatty(fd) && !configureTty(fd, speed)) {
+    perror("tcsetattr");
+    return 1;
+  }
+
+  FrameParser parser;
+  uint8_t buf[256];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < n; i++)
+      parser.feed(buf[i]);
+  }
+
+  if (fd != STDIN_FILENO)
+    close(fd);
+  return n < 0 ? 1 : 0;
+}